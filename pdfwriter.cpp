@@ -671,17 +671,18 @@ void PdfWriter::_draw(const SvgImage* node)
   //  node->m_image = node->m_image.scaled(int(scaledw + 0.5), int(scaledh + 0.5));
   //}
 
-  int wpx = node->m_image.width;
-  int hpx = node->m_image.height;
+  const Image& image = *node->image();
+  int wpx = image.width;
+  int hpx = image.height;
   int npx = wpx * hpx;
 
   int id = idImagesBase + int(mEntries.size());
   mEntries.emplace_back(id);
   ImageEntry& entry = mEntries.back();
 
-  if(node->m_image.encoding == Image::JPEG && !node->m_image.hasTransparency()) {
+  if(image.encoding == Image::JPEG && !image.hasTransparency()) {
     // JPEG
-    entry.data = node->m_image.encodeJPEG();
+    entry.data = image.encodeJPEG();
     entry.header = fstring(
         "<<\n/Type /XObject\n/Name /Img%d\n"
         "/Subtype /Image\n/ColorSpace /DeviceRGB\n"
@@ -693,7 +694,7 @@ void PdfWriter::_draw(const SvgImage* node)
     unsigned char* maskdata = new unsigned char[npx];
     unsigned char* rgbdata = new unsigned char[3*npx];
     unsigned char* rgbp = rgbdata;
-    auto bytes = node->m_image.bytesOnce();
+    auto bytes = image.bytesOnce();
     const unsigned int* pixels = (const unsigned int*)bytes;
     bool hasalpha = false;
     for(int ii = 0; ii < npx; ++ii) {
@@ -703,7 +704,7 @@ void PdfWriter::_draw(const SvgImage* node)
       *rgbp++ = (pixels[ii] >> Color::SHIFT_G) & 0xFF;
       *rgbp++ = (pixels[ii] >> Color::SHIFT_B) & 0xFF;
     }
-    if(bytes != node->m_image.data) free(bytes);
+    if(bytes != image.data) free(bytes);
 
     std::string smask;
     if(hasalpha) {
@@ -757,7 +758,7 @@ void PdfWriter::_draw(const SvgImage* node)
 
 void PdfWriter::_draw(const SvgPath* node)
 {
-  const Path2D& path = node->m_path;
+  const Path2D& path = *node->path();
   ExtraState& states = extraState();
   if(path.empty())
     return;
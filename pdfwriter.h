@@ -1,6 +1,7 @@
 #pragma once
 
 #include <functional>
+#include <list>
 #include "svgnode.h"
 #include "ulib/painter.h"
 
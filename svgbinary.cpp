@@ -0,0 +1,734 @@
+#include "svgbinary.h"
+#include "svgxml.h"
+#include "svgstyleparser.h"
+
+static const char SNAPSHOT_MAGIC[8] = {'U', 'S', 'V', 'G', 'B', 'I', 'N', '\0'};
+static constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+// SvgBinaryWriter
+
+std::vector<char> SvgBinaryWriter::serialize(const SvgDocument* doc)
+{
+  SvgBinaryWriter writer;
+  writer.out.insert(writer.out.end(), SNAPSHOT_MAGIC, SNAPSHOT_MAGIC + 8);
+  writer.put<uint32_t>(VERSION);
+  writer.put<uint32_t>(BYTE_ORDER_MARK);
+  writer.put<uint8_t>(sizeof(real));
+  writer.put<uint8_t>(sizeof(Point));
+  writer.put<uint8_t>(sizeof(Path2D::PathCommand));
+  writer.put<uint8_t>(0);
+  writer.writeNode(doc);
+  return std::move(writer.out);
+}
+
+void SvgBinaryWriter::save(const SvgDocument* doc, IOStream& strm)
+{
+  std::vector<char> buff = serialize(doc);
+  strm.write(buff.data(), buff.size());
+}
+
+void SvgBinaryWriter::putStr(const char* s, size_t len)
+{
+  put<uint32_t>(len);
+  out.insert(out.end(), s, s + len);
+}
+
+// arrays are 8-byte aligned (relative to start of snapshot)
+void SvgBinaryWriter::putBlob(const void* data, size_t count, size_t elemsize)
+{
+  put<uint32_t>(count);
+  out.resize((out.size() + 7) & ~size_t(7), 0);
+  if(count > 0)
+    out.insert(out.end(), (const char*)data, (const char*)data + count*elemsize);
+}
+
+void SvgBinaryWriter::putRect(const Rect& r)
+{
+  put<real>(r.left);  put<real>(r.top);  put<real>(r.right);  put<real>(r.bottom);
+}
+
+void SvgBinaryWriter::putPath(const Path2D& path)
+{
+  putBlob(path.points.data(), path.points.size(), sizeof(Point));
+  putBlob(path.commands.data(), path.commands.size(), sizeof(Path2D::PathCommand));
+}
+
+void SvgBinaryWriter::writeChildren(const SvgContainerNode* node)
+{
+  uint32_t n = 0;
+  for(const SvgNode* child : node->children())
+    n += child->type() != SvgNode::CUSTOM ? 1 : 0;
+  put<uint32_t>(n);
+  for(const SvgNode* child : node->children()) {
+    if(child->type() != SvgNode::CUSTOM)
+      writeNode(child);
+  }
+}
+
+// external documents are written inline at first reference
+void SvgBinaryWriter::writeExtDoc(const std::shared_ptr<SvgDocument>& doc)
+{
+  if(!doc) {
+    put<uint32_t>(0);
+    return;
+  }
+  auto it = extDocs.find(doc.get());
+  if(it != extDocs.end()) {
+    put<uint32_t>(it->second);
+    return;
+  }
+  unsigned int ref = extDocs.size() + 1;
+  extDocs[doc.get()] = ref;
+  put<uint32_t>(ref);
+  writeNode(doc.get());
+}
+
+void SvgBinaryWriter::writeNode(const SvgNode* node)
+{
+  SvgNode::Type type = node->type();
+  put<uint8_t>(type);
+  put<uint8_t>(node->m_visible);
+  put<uint8_t>(node->m_displayMode);
+  put<uint8_t>(node->hasTransform());
+  putStr(node->m_id.c_str(), node->m_id.size());
+  putStr(node->m_class.c_str(), node->m_class.size());
+  put<uint32_t>(node->attrs.size());
+  for(const SvgAttr& attr : node->attrs) {
+    putStr(attr.name(), strlen(attr.name()));
+    put<uint32_t>(attr.getFlags());
+    switch(attr.valueType()) {
+    case SvgAttr::IntVal:    put<int32_t>(attr.intVal());  break;
+    case SvgAttr::ColorVal:  put<color_t>(attr.colorVal());  break;
+    case SvgAttr::FloatVal:  put<float>(attr.floatVal());  break;
+    default:                 putStr(attr.stringVal(), attr.stringLen());  break;
+    }
+  }
+  if(node->hasTransform()) {
+    for(int ii = 0; ii < 6; ++ii)
+      put<real>(node->getTransform().m[ii]);
+  }
+
+  switch(type) {
+  case SvgNode::DOC:
+  {
+    auto doc = static_cast<const SvgDocument*>(node);
+    put<real>(doc->m_x);  put<real>(doc->m_y);
+    put<real>(doc->m_width.value);  put<uint8_t>(doc->m_width.units);
+    put<real>(doc->m_height.value);  put<uint8_t>(doc->m_height.units);
+    put<real>(doc->m_useWidth);  put<real>(doc->m_useHeight);
+    putRect(doc->m_viewBox);
+    put<uint8_t>(doc->m_preserveAspectRatio);
+    putRect(doc->m_canvasRect);
+    writeChildren(doc);
+    break;
+  }
+  case SvgNode::G:
+    put<uint8_t>(static_cast<const SvgG*>(node)->groupType);
+    writeChildren(node->asContainerNode());
+    break;
+  case SvgNode::DEFS:
+  case SvgNode::SYMBOL:
+    writeChildren(node->asContainerNode());
+    break;
+  case SvgNode::PATTERN:
+  {
+    auto pattern = static_cast<const SvgPattern*>(node);
+    putRect(pattern->m_cell);
+    put<uint8_t>(pattern->m_patternUnits);
+    put<uint8_t>(pattern->m_patternContentUnits);
+    writeChildren(pattern);
+    break;
+  }
+  case SvgNode::GRADIENT:
+  {
+    auto gradnode = static_cast<const SvgGradient*>(node);
+    const Gradient& grad = gradnode->m_gradient;
+    put<uint8_t>(grad.type);
+    put<uint8_t>(grad.coordinateMode());
+    put<uint8_t>(grad.spread());
+    put<uint8_t>(grad.colorInterp());
+    if(grad.type == Gradient::Linear) {
+      const Gradient::LinearGradCoords& g = grad.coords.linear;
+      put<real>(g.x1);  put<real>(g.y1);  put<real>(g.x2);  put<real>(g.y2);
+    }
+    else {
+      const Gradient::RadialGradCoords& g = grad.coords.radial;
+      put<real>(g.cx);  put<real>(g.cy);  put<real>(g.radius);  put<real>(g.fx);  put<real>(g.fy);
+    }
+    const char* link = gradnode->m_link ? gradnode->m_link->xmlId() : "";
+    putStr(link, strlen(link));
+    put<uint32_t>(gradnode->stops().size());
+    for(const SvgGradientStop* stop : gradnode->stops())
+      writeNode(stop);
+    break;
+  }
+  case SvgNode::PATH:
+  {
+    auto path = static_cast<const SvgPath*>(node);
+    put<uint8_t>(path->pathType());
+    putPath(*path->path());  // parses lazy path data
+    break;
+  }
+  case SvgNode::RECT:
+  {
+    auto rect = static_cast<const SvgRect*>(node);
+    putRect(rect->m_rect);
+    put<real>(rect->m_rx);  put<real>(rect->m_ry);
+    for(int ii = 0; ii < 4; ++ii)
+      put<real>(rect->m_radii[ii]);
+    break;
+  }
+  case SvgNode::IMAGE:
+  {
+    auto imgnode = static_cast<const SvgImage*>(node);
+    putRect(imgnode->m_bounds);
+    putRect(imgnode->srcRect);
+    // data URI is not saved as link if image data is saved, so embedded image is not stored twice
+    auto putImage = [&](const unsigned char* data, size_t len) {
+      if(len > 0 && imgnode->m_linkStr.compare(0, 5, "data:") == 0)
+        putStr("", 0);
+      else
+        putStr(imgnode->m_linkStr);
+      putBlob(data, len, 1);
+    };
+    // save encoded data as is if image hasn't been decoded yet (or couldn't be decoded)
+    if(imgnode->m_encoded) {
+      std::lock_guard<std::mutex> lock(imgnode->m_encoded->mutex);
+      const std::vector<unsigned char>& data = imgnode->m_encoded->data;
+      if(!data.empty()) {
+        putImage(data.data(), data.size());
+        break;
+      }
+    }
+    const Image& img = *imgnode->image();
+    if(img.width > 0 && img.height > 0) {
+      Image::Encoding fmt = img.encoding == Image::JPEG && !img.hasTransparency() ? Image::JPEG : Image::PNG;
+      auto buff = img.encode(fmt);
+      putImage(buff.data(), buff.size());
+    }
+    else
+      putImage(NULL, 0);
+    break;
+  }
+  case SvgNode::USE:
+  {
+    auto use = static_cast<const SvgUse*>(node);
+    putRect(use->viewport());
+    const char* href = use->href();
+    putStr(href, strlen(href));
+    writeExtDoc(use->externalDoc());
+    put<uint8_t>(use->externalDoc() && use->target() == use->externalDoc().get());
+    break;
+  }
+  case SvgNode::TEXT:
+  case SvgNode::TSPAN:
+  case SvgNode::TEXTPATH:
+  {
+    auto tspan = static_cast<const SvgTspan*>(node);
+    if(type == SvgNode::TEXTPATH) {
+      auto textpath = static_cast<const SvgTextPath*>(node);
+      putStr(textpath->href(), strlen(textpath->href()));
+      put<real>(textpath->startOffset());
+    }
+    put<uint8_t>(tspan->m_isTspan);
+    putBlob(tspan->m_x.data(), tspan->m_x.size(), sizeof(real));
+    putBlob(tspan->m_y.data(), tspan->m_y.size(), sizeof(real));
+    putStr(tspan->m_text);
+    put<uint32_t>(tspan->tspans().size());
+    for(const SvgTspan* child : tspan->tspans())
+      writeNode(child);
+    break;
+  }
+  case SvgNode::FONT:
+  {
+    auto font = static_cast<const SvgFont*>(node);
+    putStr(font->m_familyName);
+    put<real>(font->m_unitsPerEm);
+    put<real>(font->m_horizAdvX);
+    put<uint32_t>(font->m_glyphs.get().size());
+    for(const SvgGlyph* glyph : font->m_glyphs.get())
+      writeNode(glyph);
+    put<uint32_t>(font->m_kerning.size());
+    for(const SvgFont::Kerning& kern : font->m_kerning) {
+      putStr(kern.g1);  putStr(kern.g2);  putStr(kern.u1);  putStr(kern.u2);
+      put<real>(kern.k);
+    }
+    put<uint8_t>(bool(font->m_fontface));
+    if(font->m_fontface)
+      writeNode(font->m_fontface.get());
+    break;
+  }
+  case SvgNode::GLYPH:
+  {
+    auto glyph = static_cast<const SvgGlyph*>(node);
+    putStr(glyph->m_name);
+    putStr(glyph->m_unicode);
+    put<real>(glyph->m_horizAdvX);
+    putPath(glyph->m_path);
+    break;
+  }
+  case SvgNode::UNKNOWN:
+  {
+    const XmlFragment* frag = static_cast<const SvgXmlFragment*>(node)->fragment.get();
+    putStr(frag ? frag->data() : "", frag ? frag->size() : 0);
+    break;
+  }
+  default:  // STOP, FONTFACE have no additional data
+    break;
+  }
+}
+
+// SvgBinaryReader
+
+SvgDocument* SvgBinaryReader::load(const char* data, size_t len)
+{
+  SvgBinaryReader reader(data, len);
+  if(!reader.readHeader()) {
+    PLATFORM_LOG("SVG snapshot has invalid header or was written by incompatible build\n");
+    return NULL;
+  }
+  SvgDocument* doc = reader.readRoot();
+  if(!doc)
+    PLATFORM_LOG("Error reading SVG snapshot at offset %d\n", int(reader.p - reader.base));
+  return doc;
+}
+
+SvgDocument* SvgBinaryReader::loadFile(const char* filename)
+{
+  MappedFile mapped(filename);
+  if(!mapped.data) {
+    PLATFORM_LOG("Error opening %s\n", filename);
+    return NULL;
+  }
+  return load(mapped.data, mapped.size);
+}
+
+bool SvgBinaryReader::readHeader()
+{
+  if(size_t(end - p) < 8 || memcmp(p, SNAPSHOT_MAGIC, 8) != 0)
+    return false;
+  p += 8;
+  bool valid = get<uint32_t>() == SvgBinaryWriter::VERSION;
+  valid = get<uint32_t>() == BYTE_ORDER_MARK && valid;
+  valid = get<uint8_t>() == sizeof(real) && valid;
+  valid = get<uint8_t>() == sizeof(Point) && valid;
+  valid = get<uint8_t>() == sizeof(Path2D::PathCommand) && valid;
+  get<uint8_t>();
+  return valid && ok;
+}
+
+std::string SvgBinaryReader::getStr()
+{
+  uint32_t len = get<uint32_t>();
+  if(!ok || len > size_t(end - p)) {
+    ok = false;
+    return std::string();
+  }
+  std::string s(p, len);
+  p += len;
+  return s;
+}
+
+const char* SvgBinaryReader::getBlob(size_t* count, size_t elemsize)
+{
+  *count = 0;
+  uint32_t n = get<uint32_t>();
+  size_t offset = ((p - base) + 7) & ~size_t(7);
+  if(!ok || offset > size_t(end - base) || n > size_t(end - base - offset)/elemsize) {
+    ok = false;
+    return NULL;
+  }
+  const char* data = base + offset;
+  p = data + n*elemsize;
+  *count = n;
+  return data;
+}
+
+Rect SvgBinaryReader::getRect()
+{
+  Rect r;
+  r.left = get<real>();  r.top = get<real>();  r.right = get<real>();  r.bottom = get<real>();
+  return r;
+}
+
+void SvgBinaryReader::getPath(Path2D& path)
+{
+  getVector(path.points);
+  getVector(path.commands);
+}
+
+SvgDocument* SvgBinaryReader::readRoot()
+{
+  RootState rs;
+  if(p >= end || *p != SvgNode::DOC) {
+    ok = false;
+    return NULL;
+  }
+  SvgDocument* root = static_cast<SvgDocument*>(readNode(NULL, NULL, rs));
+  if(!root)
+    return NULL;
+  for(auto& named : rs.namedNodes)
+    named.first->addNamedNode(named.second);
+  for(auto& link : rs.gradLinks) {
+    SvgNode* target = link.first->getRefTarget(link.second.c_str());
+    if(target && target->type() == SvgNode::GRADIENT)
+      link.first->setStopLink(static_cast<SvgGradient*>(target));
+  }
+  for(SvgFont* font : rs.fonts)
+    root->addSvgFont(font);
+#ifndef NO_DYNAMIC_STYLE
+  // attributes from CSS are already applied, so we only need stylesheet for future restyling
+  if(!rs.css.empty())
+    root->setStylesheet(SvgCssStylesheet::fromText(rs.css));
+#endif
+  return root;
+}
+
+bool SvgBinaryReader::readChildren(SvgContainerNode* node, SvgDocument* doc, RootState& rs)
+{
+  uint32_t n = get<uint32_t>();
+  for(uint32_t ii = 0; ii < n && ok; ++ii) {
+    SvgNode* child = readNode(node, doc, rs);
+    if(!child)
+      return false;
+    node->children().push_back(child);
+  }
+  return ok;
+}
+
+std::shared_ptr<SvgDocument> SvgBinaryReader::readExtDoc()
+{
+  uint32_t ref = get<uint32_t>();
+  if(ref == 0 || !ok)
+    return {};
+  if(ref <= extDocs.size())
+    return extDocs[ref - 1];
+  if(ref != extDocs.size() + 1) {
+    ok = false;
+    return {};
+  }
+  extDocs.emplace_back();
+  SvgDocument* extdoc = readRoot();
+  if(!extdoc)
+    return {};
+  extDocs[ref - 1].reset(extdoc);
+  return extDocs[ref - 1];
+}
+
+// ids are registered in doc, except for tspans, glyphs, and font-face, to match SvgParser
+SvgNode* SvgBinaryReader::readNode(SvgNode* parent, SvgDocument* doc, RootState& rs)
+{
+  if(depth >= MAX_DEPTH) {
+    ok = false;
+    return NULL;
+  }
+  auto type = SvgNode::Type(get<uint8_t>());
+  bool visible = get<uint8_t>();
+  auto display = SvgNode::DisplayMode(get<uint8_t>());
+  bool hastf = get<uint8_t>();
+  std::string id = getStr();
+  std::string cls = getStr();
+  SvgAttrList attrs;
+  uint32_t nattrs = get<uint32_t>();
+  attrs.reserve(std::min(nattrs, uint32_t(end - p)/8));
+  for(uint32_t ii = 0; ii < nattrs && ok; ++ii) {
+    std::string name = getStr();
+    unsigned int flags = get<uint32_t>();
+    int f = flags & ~0x0F00;
+    switch(flags & 0x0F00) {
+    case SvgAttr::IntVal:    attrs.emplace_back(name.c_str(), get<int32_t>(), f);  break;
+    case SvgAttr::ColorVal:  attrs.emplace_back(name.c_str(), get<color_t>(), f);  break;
+    case SvgAttr::FloatVal:  attrs.emplace_back(name.c_str(), get<float>(), f);  break;
+    case SvgAttr::StringVal:
+    {
+      std::string val = getStr();
+      attrs.emplace_back(name.c_str(), (const void*)val.data(), val.size(), f);
+      break;
+    }
+    default:
+      ok = false;
+      break;
+    }
+  }
+  std::unique_ptr<Transform2D> tf;
+  if(hastf) {
+    tf.reset(new Transform2D);
+    for(int ii = 0; ii < 6; ++ii)
+      tf->m[ii] = get<real>();
+  }
+  if(!ok)
+    return NULL;
+
+  SvgNode* node = NULL;
+  SvgDocument* childdoc = doc;
+  bool registerId = true;
+  switch(type) {
+  case SvgNode::DOC:
+  {
+    real x = get<real>();
+    real y = get<real>();
+    real w = get<real>();
+    auto wunits = SvgLength::Units(get<uint8_t>());
+    real h = get<real>();
+    auto hunits = SvgLength::Units(get<uint8_t>());
+    SvgDocument* newdoc = new SvgDocument(x, y, SvgLength(w, wunits), SvgLength(h, hunits));
+    newdoc->m_useWidth = get<real>();
+    newdoc->m_useHeight = get<real>();
+    newdoc->m_viewBox = getRect();
+    newdoc->m_preserveAspectRatio = get<uint8_t>();
+    newdoc->m_canvasRect = getRect();
+    node = childdoc = newdoc;
+    break;
+  }
+  case SvgNode::G:
+    node = new SvgG(SvgNode::Type(get<uint8_t>()));
+    break;
+  case SvgNode::DEFS:
+    node = new SvgDefs();
+    break;
+  case SvgNode::SYMBOL:
+    node = new SvgSymbol();
+    break;
+  case SvgNode::PATTERN:
+  {
+    Rect cell = getRect();
+    auto pu = SvgPattern::Units_t(get<uint8_t>());
+    auto pcu = SvgPattern::Units_t(get<uint8_t>());
+    node = new SvgPattern(cell.left, cell.top, cell.width(), cell.height(), pu, pcu);
+    break;
+  }
+  case SvgNode::GRADIENT:
+  {
+    auto gradtype = get<uint8_t>();
+    auto coordmode = get<uint8_t>();
+    auto spread = get<uint8_t>();
+    auto interp = get<uint8_t>();
+    Gradient grad = gradtype == Gradient::Linear ? Gradient::linear(0, 0, 0, 0) : Gradient::radial(0, 0, 0, 0, 0);
+    if(gradtype == Gradient::Linear) {
+      Gradient::LinearGradCoords& g = grad.coords.linear;
+      g.x1 = get<real>();  g.y1 = get<real>();  g.x2 = get<real>();  g.y2 = get<real>();
+    }
+    else {
+      Gradient::RadialGradCoords& g = grad.coords.radial;
+      g.cx = get<real>();  g.cy = get<real>();  g.radius = get<real>();  g.fx = get<real>();  g.fy = get<real>();
+    }
+    grad.setCoordinateMode(decltype(grad.coordinateMode())(coordmode));
+    grad.setSpread(Gradient::Spread(spread));
+    grad.setColorInterp(decltype(grad.colorInterp())(interp));
+    std::string link = getStr();
+    SvgGradient* gradnode = new SvgGradient(std::move(grad));
+    if(!link.empty())
+      rs.gradLinks.emplace_back(gradnode, std::move(link));
+    node = gradnode;
+    break;
+  }
+  case SvgNode::STOP:
+    node = new SvgGradientStop();
+    break;
+  case SvgNode::PATH:
+  {
+    SvgPath* path = new SvgPath(SvgNode::Type(get<uint8_t>()));
+    getPath(path->m_path);
+    node = path;
+    break;
+  }
+  case SvgNode::RECT:
+  {
+    Rect rect = getRect();
+    real rx = get<real>();
+    real ry = get<real>();
+    real radii[4];
+    for(int ii = 0; ii < 4; ++ii)
+      radii[ii] = get<real>();
+    SvgRect* rectnode = new SvgRect(rect, rx, ry);
+    if(radii[0] != 0 || radii[1] != 0 || radii[2] != 0 || radii[3] != 0)
+      rectnode->setCornerRadii(radii[0], radii[1], radii[2], radii[3]);
+    node = rectnode;
+    break;
+  }
+  case SvgNode::IMAGE:
+  {
+    Rect bounds = getRect();
+    Rect srcRect = getRect();
+    std::string link = getStr();
+    size_t len;
+    const unsigned char* data = (const unsigned char*)getBlob(&len, 1);
+    SvgImage* img = len > 0 ? new SvgImage(std::vector<unsigned char>(data, data + len), bounds, link.c_str())
+        : new SvgImage(Image(0, 0), bounds, link.c_str());
+    img->srcRect = srcRect;
+    node = img;
+    break;
+  }
+  case SvgNode::USE:
+  {
+    Rect viewport = getRect();
+    std::string href = getStr();
+    std::shared_ptr<SvgDocument> extdoc = readExtDoc();
+    bool linkisdoc = get<uint8_t>();
+    node = new SvgUse(viewport, href.c_str(), linkisdoc ? extdoc.get() : NULL, extdoc);
+    break;
+  }
+  case SvgNode::TEXT:
+  case SvgNode::TSPAN:
+  case SvgNode::TEXTPATH:
+  {
+    SvgTspan* tspan = NULL;
+    if(type == SvgNode::TEXTPATH) {
+      std::string href = getStr();
+      real offset = get<real>();
+      tspan = new SvgTextPath(href.c_str(), offset);
+    }
+    else
+      tspan = type == SvgNode::TEXT ? new SvgText() : new SvgTspan();
+    tspan->m_isTspan = get<uint8_t>();
+    getVector(tspan->m_x);
+    getVector(tspan->m_y);
+    tspan->m_text = getStr();
+    registerId = false;
+    node = tspan;
+    break;
+  }
+  case SvgNode::FONT:
+  {
+    std::string family = getStr();
+    real unitsPerEm = get<real>();
+    SvgFont* font = new SvgFont(get<real>());
+    font->setFamilyName(family.c_str());
+    font->setUnitsPerEm(unitsPerEm);
+    node = font;
+    break;
+  }
+  case SvgNode::GLYPH:
+  {
+    std::string name = getStr();
+    std::string unicode = getStr();
+    SvgGlyph* glyph = new SvgGlyph(name.c_str(), unicode.c_str(), get<real>());
+    getPath(glyph->m_path);
+    registerId = false;
+    node = glyph;
+    break;
+  }
+  case SvgNode::FONTFACE:
+    node = new SvgFontFace();
+    registerId = false;
+    break;
+  case SvgNode::UNKNOWN:
+  {
+    // all fragments share one buffer, as for XmlStreamReader
+    uint32_t len = get<uint32_t>();
+    if(!ok || len > size_t(end - p)) {
+      ok = false;
+      return NULL;
+    }
+    if(!fragStore || fragStore->size() >= XmlFragment::MAX_SHARED_STORE)
+      fragStore = std::make_shared<std::string>();
+    size_t offset = fragStore->size();
+    fragStore->append(p, len);
+    p += len;
+    XmlFragment* frag = new XmlFragment(fragStore, offset, len);
+    // collect CSS to rebuild stylesheet
+    if(frag->name() == "style") {
+      pugi::xml_document styledoc;
+      frag->load(styledoc);
+      pugi::xml_node elem = styledoc.first_child();
+      StringRef styletype(elem.attribute("type").value());
+      if(styletype.isEmpty() || styletype == "text/css") {
+        for(pugi::xml_node child : elem.children()) {
+          if(child.type() == pugi::node_pcdata || child.type() == pugi::node_cdata)
+            rs.css.append(child.value()).append("\n");
+        }
+      }
+    }
+    node = new SvgXmlFragment(frag);
+    break;
+  }
+  default:
+    ok = false;
+    return NULL;
+  }
+
+  node->m_id = SvgAtom(id);
+  node->setClassAtom(SvgAtom(cls));
+  node->attrs = std::move(attrs);
+  node->transform = std::move(tf);
+  node->m_visible = visible;
+  node->m_displayMode = display;
+  node->setParent(parent);
+  if(registerId && doc && !node->m_id.empty())
+    rs.namedNodes.emplace_back(doc, node);
+
+  // children
+  ++depth;
+  if(node->asContainerNode())
+    readChildren(node->asContainerNode(), childdoc, rs);
+  else if(type == SvgNode::GRADIENT) {
+    SvgGradient* gradnode = static_cast<SvgGradient*>(node);
+    uint32_t n = get<uint32_t>();
+    for(uint32_t ii = 0; ii < n && ok; ++ii) {
+      SvgNode* stop = readNode(node, doc, rs);
+      if(!stop)
+        break;
+      if(stop->type() != SvgNode::STOP) {
+        delete stop;
+        ok = false;
+        break;
+      }
+      gradnode->stops().push_back(static_cast<SvgGradientStop*>(stop));
+    }
+  }
+  else if(type == SvgNode::TEXT || type == SvgNode::TSPAN || type == SvgNode::TEXTPATH) {
+    SvgTspan* tspan = static_cast<SvgTspan*>(node);
+    uint32_t n = get<uint32_t>();
+    for(uint32_t ii = 0; ii < n && ok; ++ii) {
+      SvgNode* child = readNode(node, NULL, rs);
+      if(!child)
+        break;
+      if(child->type() != SvgNode::TSPAN && child->type() != SvgNode::TEXTPATH) {
+        delete child;
+        ok = false;
+        break;
+      }
+      tspan->tspans().push_back(static_cast<SvgTspan*>(child));
+    }
+  }
+  else if(type == SvgNode::FONT) {
+    SvgFont* font = static_cast<SvgFont*>(node);
+    uint32_t nglyphs = get<uint32_t>();
+    for(uint32_t ii = 0; ii < nglyphs && ok; ++ii) {
+      SvgNode* glyph = readNode(NULL, NULL, rs);
+      if(!glyph)
+        break;
+      if(glyph->type() != SvgNode::GLYPH) {
+        delete glyph;
+        ok = false;
+        break;
+      }
+      font->addGlyph(static_cast<SvgGlyph*>(glyph));
+    }
+    uint32_t nkern = get<uint32_t>();
+    for(uint32_t ii = 0; ii < nkern && ok; ++ii) {
+      SvgFont::Kerning kern;
+      kern.g1 = getStr();  kern.g2 = getStr();  kern.u1 = getStr();  kern.u2 = getStr();
+      kern.k = get<real>();
+      font->m_kerning.push_back(std::move(kern));
+    }
+    if(ok && get<uint8_t>()) {
+      SvgNode* fontface = readNode(NULL, NULL, rs);
+      if(fontface && fontface->type() == SvgNode::FONTFACE)
+        font->setFontFaceNode(static_cast<SvgFontFace*>(fontface));
+      else {
+        delete fontface;
+        ok = false;
+      }
+    }
+    if(ok && !font->m_familyName.empty())
+      rs.fonts.push_back(font);
+  }
+  --depth;
+
+  if(!ok) {
+    delete node;
+    return NULL;
+  }
+  return node;
+}
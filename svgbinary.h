@@ -0,0 +1,102 @@
+#pragma once
+
+#include "svgnode.h"
+
+struct IOStream;
+
+// Binary snapshot of an SvgDocument tree for reloading w/o parsing: attributes are stored w/ their parsed values,
+//  path points and commands and text x/y lists are stored as raw arrays, and images are stored encoded (and are
+//  decoded lazily after loading).  Loading is not zero-copy: every node is allocated and path, text, image, and
+//  fragment data is copied out of the snapshot (Path2D and SvgImage own their storage, so they can't point into
+//  a mapping; loadFile() only avoids reading file into a separate buffer), so load time is proportional to
+//  snapshot size - a memcpy per array and an allocation per node instead of tokenizing and number parsing.
+//  usvgtest logs load time and throughput.  The format is only intended to be read by the same build - a snapshot
+//  is rejected if version, byte order, or sizes of real, Point, or PathCommand differ.  Extensions and
+//  SvgCustomNodes are not saved.
+class SvgBinaryWriter
+{
+public:
+  static constexpr unsigned int VERSION = 1;
+
+  static std::vector<char> serialize(const SvgDocument* doc);
+  static void save(const SvgDocument* doc, IOStream& strm);
+
+private:
+  std::vector<char> out;
+  std::unordered_map<const SvgDocument*, unsigned int> extDocs;
+
+  template<typename T> void put(const T& val)
+  {
+    size_t n = out.size();
+    out.resize(n + sizeof(T));
+    memcpy(&out[n], &val, sizeof(T));
+  }
+  void putStr(const char* s, size_t len);
+  void putStr(const std::string& s) { putStr(s.data(), s.size()); }
+  void putBlob(const void* data, size_t count, size_t elemsize);
+  void putRect(const Rect& r);
+  void putPath(const Path2D& path);
+
+  void writeNode(const SvgNode* node);
+  void writeChildren(const SvgContainerNode* node);
+  void writeExtDoc(const std::shared_ptr<SvgDocument>& doc);
+};
+
+class SvgBinaryReader
+{
+public:
+  // both return NULL if data is not a valid snapshot or nodes are nested more than MAX_DEPTH deep
+  static constexpr size_t MAX_DEPTH = 1024;
+  static SvgDocument* load(const char* data, size_t len);
+  static SvgDocument* loadFile(const char* filename);
+
+private:
+  const char* base;
+  const char* p;
+  const char* end;
+  bool ok = true;
+  size_t depth = 0;
+  std::vector< std::shared_ptr<SvgDocument> > extDocs;
+  std::shared_ptr<std::string> fragStore;
+
+  // per root document state, resolved after tree is built
+  struct RootState {
+    std::vector< std::pair<SvgGradient*, std::string> > gradLinks;
+    std::vector<SvgFont*> fonts;
+    // ids are registered once whole tree is read so a failed subtree never leaves entries behind
+    std::vector< std::pair<SvgDocument*, SvgNode*> > namedNodes;
+    std::string css;
+  };
+
+  SvgBinaryReader(const char* data, size_t len) : base(data), p(data), end(data + len) {}
+
+  template<typename T> T get()
+  {
+    T val = T();
+    if(ok && size_t(end - p) >= sizeof(T)) {
+      memcpy(&val, p, sizeof(T));
+      p += sizeof(T);
+    }
+    else
+      ok = false;
+    return val;
+  }
+  std::string getStr();
+  const char* getBlob(size_t* count, size_t elemsize);
+  template<typename T> void getVector(std::vector<T>& v)
+  {
+    size_t n;
+    const char* src = getBlob(&n, sizeof(T));
+    v.resize(n);
+    if(n > 0)
+      memcpy(v.data(), src, n*sizeof(T));
+  }
+  Rect getRect();
+  void getPath(Path2D& path);
+
+  bool readHeader();
+  SvgDocument* readRoot();
+  SvgNode* readNode(SvgNode* parent, SvgDocument* doc, RootState& rs);
+  bool readChildren(SvgContainerNode* node, SvgDocument* doc, RootState& rs);
+  std::shared_ptr<SvgDocument> readExtDoc();
+};
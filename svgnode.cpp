@@ -1,49 +1,447 @@
+#include <thread>
+#include <deque>
+#include <condition_variable>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#include <algorithm>
 #include "svgnode.h"
 #include "svgstyleparser.h"
 #include "svgpainter.h"  // only needed for bounds()
 #include "svgxml.h"
+#include "svgparser.h"  // only needed for SvgPath::parsePathData()
 
 
 const char* SvgLength::unitNames[] = {"px", "pt", "em", "ex", "%"};
 real SvgLength::defaultDpi = 96;
 
-// we could add a separate constexpr fn to do this mapping at compile time for things like case labels,
-//  e.g. case SVG_ATTR("fill"):  but I'm not sure the extra complication is worthwhile
+// SvgAtom
+
+namespace {
+struct AtomKey {
+  const char* str;
+  size_t len;
+  friend bool operator==(const AtomKey& a, const AtomKey& b)
+    { return a.len == b.len && memcmp(a.str, b.str, a.len) == 0; }
+};
+struct AtomKeyHash { size_t operator()(const AtomKey& k) const { return svgHash(k.str, k.len); } };
+}
+
+// table is split into shards, each w/ its own lock, so that threads parsing different documents rarely wait on
+//  each other; keys point to strings in entries
+namespace {
+struct AtomShard {
+  std::mutex mutex;
+  std::unordered_map<AtomKey, void*, AtomKeyHash> table;
+  size_t bytes = 0;
+};
+}
+
+static constexpr size_t ATOM_SHARDS = 16;
+
+static AtomShard* atomShards()
+{
+  static AtomShard shards[ATOM_SHARDS];
+  return shards;
+}
+
+SvgAtom::Entry* SvgAtom::intern(const char* s, size_t len, bool immortal)
+{
+  uint8_t shardidx = uint8_t(svgHash(s, len) % ATOM_SHARDS);
+  AtomShard& shard = atomShards()[shardidx];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.table.find(AtomKey{s, len});
+  if(it != shard.table.end()) {
+    Entry* e = static_cast<Entry*>(it->second);
+    e->refs.fetch_add(1, std::memory_order_relaxed);
+    return e;
+  }
+  size_t nbytes = offsetof(Entry, str) + len + 1;
+  Entry* e = static_cast<Entry*>(::operator new(nbytes));
+  new(&e->refs) std::atomic<int>(1);
+  e->immortal = immortal;
+  e->shard = shardidx;
+  e->len = len;
+  memcpy(e->str, s, len);
+  e->str[len] = '\0';
+  shard.table.emplace(AtomKey{e->str, len}, e);
+  shard.bytes += nbytes;
+  return e;
+}
+
+// the last reference is only dropped while holding the table lock, so intern() never returns a dying entry
+void SvgAtom::release(Entry* e)
+{
+  int refs = e->refs.load(std::memory_order_relaxed);
+  while(refs > 1) {
+    if(e->refs.compare_exchange_weak(refs, refs - 1, std::memory_order_release, std::memory_order_relaxed))
+      return;
+  }
+  AtomShard& shard = atomShards()[e->shard];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  if(e->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    shard.table.erase(AtomKey{e->str, e->len});
+    shard.bytes -= offsetof(Entry, str) + e->len + 1;
+    e->refs.~atomic<int>();
+    ::operator delete(e);
+  }
+}
+
+size_t SvgAtom::tableSize()
+{
+  size_t n = 0;
+  for(size_t ii = 0; ii < ATOM_SHARDS; ++ii) {
+    AtomShard& shard = atomShards()[ii];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    n += shard.table.size();
+  }
+  return n;
+}
+
+size_t SvgAtom::tableMemoryUsage()
+{
+  size_t bytes = 0;
+  for(size_t ii = 0; ii < ATOM_SHARDS; ++ii) {
+    AtomShard& shard = atomShards()[ii];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    bytes += shard.bytes + shard.table.bucket_count()*sizeof(void*)
+        + shard.table.size()*(sizeof(AtomKey) + 2*sizeof(void*) + sizeof(size_t));
+  }
+  return bytes;
+}
+
+// SvgAttr
+
+static constexpr SvgEnumVal stdAttrNames[] = {
+  {"color", SvgAttr::COLOR}, {"comp-op", SvgAttr::COMP_OP}, {"display", SvgAttr::DISPLAY},
+  {"fill", SvgAttr::FILL}, {"fill-opacity", SvgAttr::FILL_OPACITY}, {"fill-rule", SvgAttr::FILL_RULE},
+  {"font-family", SvgAttr::FONT_FAMILY}, {"font-size", SvgAttr::FONT_SIZE}, {"font-style", SvgAttr::FONT_STYLE},
+  {"font-variant", SvgAttr::FONT_VARIANT}, {"font-weight", SvgAttr::FONT_WEIGHT}, {"offset", SvgAttr::OFFSET},
+  {"opacity", SvgAttr::OPACITY}, {"shape-rendering", SvgAttr::SHAPE_RENDERING},
+  {"stop-color", SvgAttr::STOP_COLOR}, {"stop-opacity", SvgAttr::STOP_OPACITY}, {"stroke", SvgAttr::STROKE},
+  {"stroke-dasharray", SvgAttr::STROKE_DASHARRAY}, {"stroke-dashoffset", SvgAttr::STROKE_DASHOFFSET},
+  {"stroke-linecap", SvgAttr::STROKE_LINECAP}, {"stroke-linejoin", SvgAttr::STROKE_LINEJOIN},
+  {"stroke-miterlimit", SvgAttr::STROKE_MITERLIMIT}, {"stroke-opacity", SvgAttr::STROKE_OPACITY},
+  {"stroke-width", SvgAttr::STROKE_WIDTH}, {"text-anchor", SvgAttr::TEXT_ANCHOR},
+  {"vector-effect", SvgAttr::VECTOR_EFFECT}, {"visibility", SvgAttr::VISIBILITY},
+  {"letter-spacing", SvgAttr::LETTER_SPACING}, {"stroke-alignment", SvgAttr::STROKE_ALIGNMENT}
+};
+
 SvgAttr::StdAttr SvgAttr::nameToStdAttr(const char* name)
 {
-  static std::unordered_map<std::string, StdAttr> stdAttrMap = {
-    {"color", COLOR}, {"comp-op", COMP_OP}, {"display", DISPLAY}, {"fill", FILL}, {"fill-opacity", FILL_OPACITY},
-    {"fill-rule", FILL_RULE}, {"font-family", FONT_FAMILY}, {"font-size", FONT_SIZE},
-    {"font-style", FONT_STYLE}, {"font-variant", FONT_VARIANT}, {"font-weight", FONT_WEIGHT},
-    {"offset", OFFSET}, {"opacity", OPACITY}, {"shape-rendering", SHAPE_RENDERING}, {"stop-color", STOP_COLOR},
-    {"stop-opacity", STOP_OPACITY}, {"stroke", STROKE}, {"stroke-dasharray", STROKE_DASHARRAY},
-    {"stroke-dashoffset", STROKE_DASHOFFSET}, {"stroke-linecap", STROKE_LINECAP},
-    {"stroke-linejoin", STROKE_LINEJOIN}, {"stroke-miterlimit", STROKE_MITERLIMIT},
-    {"stroke-opacity", STROKE_OPACITY}, {"stroke-width", STROKE_WIDTH}, {"text-anchor", TEXT_ANCHOR},
-    {"vector-effect", VECTOR_EFFECT}, {"visibility", VISIBILITY}, {"letter-spacing", LETTER_SPACING},
-    {"stroke-alignment", STROKE_ALIGNMENT}
-  };
+  static constexpr auto stdAttrMap = makeKeywordMap(stdAttrNames);
+  return StdAttr(stdAttrMap.find(name, UNKNOWN));
+}
+
+// entries are immortal, so copying these atoms doesn't touch refcount (shared by all threads)
+const SvgAtom& SvgAttr::stdAttrAtom(StdAttr stdattr)
+{
+  static const std::vector<SvgAtom> atoms = [](){
+    std::vector<SvgAtom> v(STROKE_ALIGNMENT + 1);
+    for(const SvgEnumVal& enumval : stdAttrNames)
+      v[enumval.val].e = SvgAtom::intern(enumval.str, strlen(enumval.str), true);
+    return v;
+  }();
+  return atoms[stdattr];
+}
 
-  auto it = stdAttrMap.find(name);
-  return it != stdAttrMap.end() ? it->second : UNKNOWN;
+SvgAttr::SvgAttr(InitName, const char* n, int f) : flags(f)
+{
+  StdAttr stdattr = (f & 0xFF) ? StdAttr(f & 0xFF) : nameToStdAttr(n);
+  if(stdattr != UNKNOWN) {
+    m_name = stdAttrAtom(stdattr);
+    flags |= stdattr;
+  }
+  else
+    m_name = SvgAtom(n);
 }
 
 bool SvgAttr::nameIs(const char* s) const { return strcmp(name(), s) == 0; }
 
+size_t SvgAttr::hash() const
+{
+  size_t h = std::hash<const void*>()(m_name.c_str())*31 + flags;
+  switch(valueType()) {
+    case IntVal: return h*31 + unsigned(value.intVal);
+    case ColorVal: return h*31 + value.colorVal;
+    case FloatVal: { uint32_t bits;  memcpy(&bits, &value.floatVal, 4);  return h*31 + bits; }
+    case StringVal: return h*31 + svgHash(value.strVal, strLen);
+  }
+  return h;
+}
+
 bool operator==(const SvgAttr& a, const SvgAttr& b)
 {
-  if(a.flags != b.flags || a.str != b.str)
+  if(a.flags != b.flags || a.m_name != b.m_name)
     return false;
   // In C++ I think memcmp would work here (but not C due to unintialized padding)
   switch(a.valueType()) {
     case SvgAttr::IntVal: return a.value.intVal == b.value.intVal;
     case SvgAttr::ColorVal: return a.value.colorVal == b.value.colorVal;
     case SvgAttr::FloatVal: return a.value.floatVal == b.value.floatVal;
-    case SvgAttr::StringVal: return a.value.strOffset == b.value.strOffset;
+    case SvgAttr::StringVal:
+      return a.strLen == b.strLen && memcmp(a.value.strVal, b.value.strVal, a.strLen) == 0;
   }
   return false;
 }
 
+// SvgArena
+
+thread_local SvgArena* SvgArena::current = NULL;
+std::atomic<bool> SvgArena::used(false);
+
+// chunk table: open addressing w/ linear probing; slots are only written while holding lock, but read w/o lock
+//  by owner().  Each chunk begins w/ pointer to its arena
+static constexpr size_t CHUNK_TABLE_SIZE = 1 << 14;  // so up to 1 GB of arena chunks; then heap is used
+static constexpr uintptr_t CHUNK_TOMBSTONE = 1;
+static std::atomic<uintptr_t> chunkTable[CHUNK_TABLE_SIZE];
+static std::mutex chunkTableMutex;
+
+static size_t chunkSlot(uintptr_t base)
+{
+  return size_t((base/SvgArena::CHUNK_SIZE)*2654435761u) & (CHUNK_TABLE_SIZE - 1);
+}
+
+static char* allocChunk()
+{
+  void* chunk = NULL;
+#ifdef _WIN32
+  chunk = _aligned_malloc(SvgArena::CHUNK_SIZE, SvgArena::CHUNK_SIZE);
+#else
+  if(posix_memalign(&chunk, SvgArena::CHUNK_SIZE, SvgArena::CHUNK_SIZE) != 0)
+    return NULL;
+#endif
+  std::lock_guard<std::mutex> lock(chunkTableMutex);
+  uintptr_t base = uintptr_t(chunk);
+  for(size_t ii = chunkSlot(base), n = 0; n < CHUNK_TABLE_SIZE; ii = (ii + 1) & (CHUNK_TABLE_SIZE - 1), ++n) {
+    uintptr_t slot = chunkTable[ii].load(std::memory_order_relaxed);
+    if(slot == 0 || slot == CHUNK_TOMBSTONE) {
+      chunkTable[ii].store(base, std::memory_order_release);
+      return static_cast<char*>(chunk);
+    }
+  }
+#ifdef _WIN32
+  _aligned_free(chunk);
+#else
+  free(chunk);
+#endif
+  return NULL;
+}
+
+static void freeChunk(char* chunk)
+{
+  {
+    std::lock_guard<std::mutex> lock(chunkTableMutex);
+    uintptr_t base = uintptr_t(chunk);
+    for(size_t ii = chunkSlot(base), n = 0; n < CHUNK_TABLE_SIZE; ii = (ii + 1) & (CHUNK_TABLE_SIZE - 1), ++n) {
+      if(chunkTable[ii].load(std::memory_order_relaxed) == base) {
+        chunkTable[ii].store(CHUNK_TOMBSTONE, std::memory_order_release);
+        break;
+      }
+    }
+  }
+#ifdef _WIN32
+  _aligned_free(chunk);
+#else
+  free(chunk);
+#endif
+}
+
+SvgArena* SvgArena::owner(const void* p)
+{
+  if(!used.load(std::memory_order_relaxed))
+    return NULL;
+  uintptr_t base = uintptr_t(p) & ~uintptr_t(CHUNK_SIZE - 1);
+  for(size_t ii = chunkSlot(base), n = 0; n < CHUNK_TABLE_SIZE; ii = (ii + 1) & (CHUNK_TABLE_SIZE - 1), ++n) {
+    uintptr_t slot = chunkTable[ii].load(std::memory_order_acquire);
+    if(slot == base)
+      return *reinterpret_cast<SvgArena**>(base);
+    if(slot == 0)
+      return NULL;
+  }
+  return NULL;
+}
+
+void* SvgArena::alloc(size_t size)
+{
+  SvgArena* arena = used.load(std::memory_order_relaxed) ? current : NULL;
+  void* block = arena && size <= MAX_BLOCK ? arena->allocBlock(size) : NULL;
+  return block ? block : ::operator new(size);
+}
+
+void SvgArena::dealloc(void* p, size_t size)
+{
+  if(!p)
+    return;
+  SvgArena* arena = owner(p);
+  if(arena)
+    arena->freeBlock(p, size);
+  else
+    ::operator delete(p);
+}
+
+void* SvgArena::allocBlock(size_t nbytes)
+{
+  size_t sizeclass = std::max(size_t(1), (nbytes + GRAIN - 1)/GRAIN);
+  FreeBlock* block = m_freeLists[sizeclass];
+  if(block) {
+    m_freeLists[sizeclass] = block->next;
+    ++m_nblocks;
+    return block;
+  }
+  nbytes = sizeclass*GRAIN;
+  if(size_t(m_end - m_next) < nbytes) {
+    char* chunk = allocChunk();
+    if(!chunk)
+      return NULL;
+    *reinterpret_cast<SvgArena**>(chunk) = this;
+    m_chunks.push_back(chunk);
+    m_next = chunk + sizeof(SvgArena*);
+    m_end = chunk + CHUNK_SIZE;
+  }
+  void* p = m_next;
+  m_next += nbytes;
+  ++m_nblocks;
+  return p;
+}
+
+void SvgArena::freeBlock(void* block, size_t nbytes)
+{
+  if(--m_nblocks == 0 && m_released) {
+    delete this;
+    return;
+  }
+  size_t sizeclass = std::max(size_t(1), (nbytes + GRAIN - 1)/GRAIN);
+  FreeBlock* freed = static_cast<FreeBlock*>(block);
+  freed->next = m_freeLists[sizeclass];
+  m_freeLists[sizeclass] = freed;
+}
+
+SvgArena::~SvgArena()
+{
+  for(char* chunk : m_chunks)
+    freeChunk(chunk);
+}
+
+// SvgAttrSet
+
+const SvgAttrList SvgAttrSet::emptyList;
+
+SvgAttrSet::SvgAttrSet(const SvgAttrSet& other) : b(other.b), m_mask(other.m_mask)
+{
+  if(!b)
+    return;
+  if(!b->interned && SvgArena::fromArena(b))
+    b = new Block(b->attrs);
+  else
+    b->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+// blocks are keyed by hash of contents; last reference to interned block is only dropped while holding lock
+static std::mutex attrTableMutex;
+static std::unordered_multimap<size_t, void*> attrTable;
+
+SvgAttrList& SvgAttrSet::mut()
+{
+  if(!b)
+    b = new Block();
+  else if(b->interned || b->refs.load(std::memory_order_acquire) > 1) {
+    Block* copy = new Block(b->attrs);
+    release(b);
+    b = copy;
+  }
+  return b->attrs;
+}
+
+void SvgAttrSet::share()
+{
+  if(!b || b->interned)
+    return;
+  if(b->attrs.empty()) {
+    release(b);
+    b = NULL;
+    return;
+  }
+  size_t hash = 0;
+  for(const SvgAttr& attr : b->attrs)
+    hash = hash*31 + attr.hash();
+
+  Block* shared = NULL;
+  {
+    std::lock_guard<std::mutex> lock(attrTableMutex);
+    auto range = attrTable.equal_range(hash);
+    for(auto it = range.first; it != range.second; ++it) {
+      Block* block = static_cast<Block*>(it->second);
+      if(block->attrs == b->attrs) {
+        block->refs.fetch_add(1, std::memory_order_relaxed);
+        shared = block;
+        break;
+      }
+    }
+    if(!shared) {
+      // shared blocks can outlive document and be used by other threads, so must not come from its arena
+      SvgArena::Scope noArena(NULL);
+      shared = new Block(b->attrs);
+      shared->interned = true;
+      shared->hash = hash;
+      attrTable.emplace(hash, shared);
+    }
+  }
+  release(b);
+  b = shared;
+}
+
+void SvgAttrSet::release(Block* block)
+{
+  if(!block->interned) {
+    if(block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      delete block;
+    return;
+  }
+  int refs = block->refs.load(std::memory_order_relaxed);
+  while(refs > 1) {
+    if(block->refs.compare_exchange_weak(refs, refs - 1, std::memory_order_release, std::memory_order_relaxed))
+      return;
+  }
+  std::lock_guard<std::mutex> lock(attrTableMutex);
+  if(block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    auto range = attrTable.equal_range(block->hash);
+    for(auto it = range.first; it != range.second; ++it) {
+      if(it->second == block) {
+        attrTable.erase(it);
+        break;
+      }
+    }
+    delete block;
+  }
+}
+
+void SvgAttrSet::updateMask()
+{
+  m_mask = 0;
+  for(const SvgAttr& attr : list())
+    markPresent(attr.stdAttr());
+}
+
+size_t SvgAttrSet::memoryUsage() const
+{
+  if(!b)
+    return 0;
+  size_t nbytes = sizeof(Block) + b->attrs.capacity()*sizeof(SvgAttr);
+  for(const SvgAttr& attr : b->attrs)
+    nbytes += attr.valueIs(SvgAttr::StringVal) ? attr.stringLen() + 1 : 0;
+  return nbytes/std::max(1, b->refs.load(std::memory_order_relaxed));
+}
+
+size_t SvgAttrSet::tableSize()
+{
+  std::lock_guard<std::mutex> lock(attrTableMutex);
+  return attrTable.size();
+}
+
 // mapping from SvgNode::Type to name
 const char* SvgNode::nodeNames[] = {"svg", "g", "a", "defs", "symbol", "pattern", "gradient", "stop", "font",
     "font-face", "glyph", "arc", "circle", "ellipse", "image", "line", "path", "polygon", "polyline", "rect",
@@ -56,7 +454,8 @@ Transform2D SvgNode::identityTransform;
 // we override default copy constructor to clear parent, and update ext node pointer; we no longer clear id
 SvgNode::SvgNode(const SvgNode& n) : attrs(n.attrs), transform(n.transform ? new Transform2D(*n.transform) : NULL),
     m_cachedBounds(), m_renderedBounds(), m_dirty(NOT_DIRTY), m_parent(NULL), m_ext(n.m_ext ? n.m_ext->clone() : NULL),
-    m_visible(n.m_visible), m_displayMode(n.m_displayMode), m_id(n.m_id), m_class(n.m_class)
+    m_visible(n.m_visible), m_displayMode(n.m_displayMode), m_id(n.m_id), m_class(n.m_class),
+    m_classTokens(n.m_classTokens)
 {
   if(m_ext)
     m_ext->node = this;
@@ -105,7 +504,7 @@ Rect SvgNode::bounds() const
   SvgDocument* root = rootDocument();
   //ASSERT(root && root->boundsCalculator && "Cannot calculate bounds!");
   if(!root || !root->boundsCalculator)
-    return SvgDocument::sharedBoundsCalc->nodeBounds(this);
+    return SvgDocument::defaultBoundsCalc()->nodeBounds(this);
   return root->boundsCalculator->nodeBounds(this);
   //Painter p;
   //return SvgPainter(&p).nodeBounds(this);
@@ -200,7 +599,7 @@ SvgDocument* SvgNode::rootDocument() const
 
 void SvgNode::setDisplayMode(DisplayMode mode)
 {
-  const SvgAttr* attr = getAttr("display", SvgAttr::XMLSrc);
+  const SvgAttr* attr = getAttr(SvgAttr::DISPLAY, SvgAttr::XMLSrc);
   if(mode != BlockMode) {
     if(!attr || attr->intVal() != mode)
       setAttr("display", mode, SvgAttr::XMLSrc);
@@ -220,27 +619,62 @@ bool SvgNode::isVisible() const
   return m_visible && isPaintable();
 }
 
-bool SvgNode::hasClass(const char* s) const { return containsWord(m_class.c_str(), s); }
+bool SvgNode::hasClass(const char* s) const
+{
+  if(m_classTokens.empty())
+    return s[0] && strcmp(m_class.c_str(), s) == 0;
+  for(const SvgAtom& token : m_classTokens) {
+    if(strcmp(token.c_str(), s) == 0)
+      return true;
+  }
+  return false;
+}
+
+bool SvgNode::hasClass(const SvgAtom& cls) const
+{
+  if(m_classTokens.empty())
+    return !cls.empty() && cls == m_class;
+  return std::find(m_classTokens.begin(), m_classTokens.end(), cls) != m_classTokens.end();
+}
+
+// class string is interned as a whole (for xmlClass()) and, if it has more than one token, token by token
+void SvgNode::setClassAtom(SvgAtom cls)
+{
+  static const char* ws = " \t\r\n";
+  m_class = std::move(cls);
+  m_classTokens.clear();
+  const char* s = m_class.c_str();
+  if(!s[strcspn(s, ws)])
+    return;  // empty or single token
+  while(*s) {
+    s += strspn(s, ws);
+    size_t len = strcspn(s, ws);
+    if(len > 0)
+      m_classTokens.emplace_back(s, len);
+    s += len;
+  }
+}
 
 void SvgNode::setXmlClass(const char* str)
 {
-  if(str != m_class) {
-    m_class = str;
+  if(strcmp(str, m_class.c_str()) != 0) {
+    setClassAtom(SvgAtom(str));
     restyle();
   }
 }
 
-void SvgNode::addClass(const char* s) { setXmlClass(addWord(m_class, s).c_str()); }
-void SvgNode::removeClass(const char* s) { setXmlClass(removeWord(m_class, s).c_str()); }
+void SvgNode::addClass(const char* s) { std::string cls(m_class.c_str());  setXmlClass(addWord(cls, s).c_str()); }
+void SvgNode::removeClass(const char* s)
+  { std::string cls(m_class.c_str());  setXmlClass(removeWord(cls, s).c_str()); }
 
 void SvgNode::setXmlId(const char* id)
 {
-  if(id == m_id)
+  if(strcmp(id, m_id.c_str()) == 0)
     return;
   SvgDocument* doc = m_parent ? m_parent->document() : document();  // handle the case where we are <svg>
   if(doc && !m_id.empty())
     doc->removeNamedNode(this);
-  m_id = id;
+  m_id = SvgAtom(id);
   if(doc && !m_id.empty())
     doc->addNamedNode(this);
   restyle();
@@ -257,20 +691,37 @@ bool SvgNode::restyle()
   SvgDocument* doc = document();
   if(!doc || !doc->canRestyle())
     return false;
+  // reference to original block (no table lock needed) so it can be restored if attributes are unchanged
+  SvgAttrSet orig;
+  if(attrs.isInterned())
+    orig = attrs;
   // mark CSS attributes stale
-  for(auto it = attrs.rbegin(); it != attrs.rend() && it->src() == SvgAttr::CSSSrc; ++it)
-    it->setStale(true);
+  if(!attrs.empty() && attrs.back().src() == SvgAttr::CSSSrc) {
+    SvgAttrList& list = attrs.mut();
+    for(auto it = list.rbegin(); it != list.rend() && it->src() == SvgAttr::CSSSrc; ++it)
+      it->setStale(true);
+  }
   doc->restyleNode(this);
-  // remove stale attrs that were not replaced; erase() doesn't accept reverse_iterator
-  for(auto it = attrs.end(); it != attrs.begin() && (--it)->src() == SvgAttr::CSSSrc;) {
-    if(it->isStale() || it->isInherit()) {
+  // remove stale attrs that were not replaced
+  for(size_t ii = attrs.size(); ii > 0 && attrs[ii-1].src() == SvgAttr::CSSSrc;) {
+    --ii;
+    if(attrs[ii].isStale() || attrs[ii].isInherit()) {
       // must erase before we call onAttrChange!
-      std::string name = it->name();
-      auto stdattr = it->stdAttr();
-      it = attrs.erase(it);
+      SvgAttrList& list = attrs.mut();
+      SvgAtom name = list[ii].nameAtom();
+      auto stdattr = list[ii].stdAttr();
+      list.erase(list.begin() + ii);
+      attrs.updateMask();
       onAttrChange(name.c_str(), stdattr);
     }
   }
+  // restyling usually leaves attributes unchanged, in which case original shared block is restored
+  if(orig.isInterned()) {
+    if(attrs.list() == orig.list())
+      attrs = std::move(orig);
+    else
+      attrs.share();
+  }
   return true;
 #endif
 }
@@ -307,13 +758,13 @@ void SvgNode::onAttrChange(const char* name, SvgAttr::StdAttr stdattr)
     case SvgAttr::DISPLAY:
     case SvgAttr::VISIBILITY:
     {
-      m_displayMode = DisplayMode(getIntAttr("display", BlockMode));
+      m_displayMode = DisplayMode(getIntAttr(SvgAttr::DISPLAY, BlockMode));
       // SvgPainter::calcDirtyRect() ignores AbsoluteMode nodes, so if we are switching a node from BlockMode,
       //  we add bounds to parent's removedBounds to get correct dirty rect
       if(stdattr == SvgAttr::DISPLAY && m_displayMode == AbsoluteMode && m_visible && m_parent->asContainerNode())
         m_parent->asContainerNode()->m_removedBounds.rectUnion(m_renderedBounds);  //bounds());
 
-      bool vis = m_displayMode != NoneMode && getIntAttr("visibility", 1);
+      bool vis = m_displayMode != NoneMode && getIntAttr(SvgAttr::VISIBILITY, 1);
       if(vis != m_visible) {
         // exactly one of these invalidate() calls will be a no-op since visible will be false
         invalidate(false);
@@ -344,48 +795,58 @@ static bool replaceAttr(SvgAttr& dest, const SvgAttr& src)
 
 bool SvgNode::setAttrHelper(const SvgAttr& attr)
 {
+  // don't copy shared attributes if unchanged (equal attr is not stale and has same src)
+  if(attrs.isShared()) {
+    for(const SvgAttr& a : attrs) {
+      if(a == attr)
+        return false;
+    }
+  }
+  SvgAttrList& list = attrs.mut();
   // Attrs are stored in the following order: XMLSrc, InlineStyleSrc, CSSSrc
   // if inline style (style=) src, insert before first CSS attr and remove any CSS w/ same name
   // if CSS src, replace CSS attr w/ same name or insert at end, unless inline style version exists
   // if XML src, insert after last XML attr (or at beginning)
   if(attr.src() == SvgAttr::XMLSrc) {
-    for(auto it = attrs.begin(); it != attrs.end(); ++it) {
-      if(it->nameIs(attr.name()) && it->src() == SvgAttr::XMLSrc)
+    for(auto it = list.begin(); it != list.end(); ++it) {
+      if(it->nameIs(attr.nameAtom()) && it->src() == SvgAttr::XMLSrc)
         return replaceAttr(*it, attr);
       else if(it->src() != SvgAttr::XMLSrc) {
-        attrs.insert(it, attr);
+        list.insert(it, attr);
+        attrs.markPresent(attr.stdAttr());
         return true;
       }
     }
-    attrs.push_back(attr);
+    list.push_back(attr);
   }
   else if(attr.src() == SvgAttr::CSSSrc) {
     // note reverse order iteration
-    for(auto it = attrs.rbegin(); it != attrs.rend() && it->src() != SvgAttr::XMLSrc; ++it) {
-      if(it->nameIs(attr.name())) {  // src is CSS or inline style
+    for(auto it = list.rbegin(); it != list.rend() && it->src() != SvgAttr::XMLSrc; ++it) {
+      if(it->nameIs(attr.nameAtom())) {  // src is CSS or inline style
         // CSS rules are processed from high to low priority, so we only replace stale attributes
         if(it->src() == SvgAttr::CSSSrc && it->isStale())
           return replaceAttr(*it, attr);
         return false;  // discard if overridden by inline style
       }
     }
-    attrs.push_back(attr);
+    list.push_back(attr);
   }
   else if(attr.src() == SvgAttr::InlineStyleSrc) {
-    auto it = attrs.begin();
-    for(; it != attrs.end() && it->src() != SvgAttr::CSSSrc; ++it) {
-      if(it->nameIs(attr.name()) && it->src() == SvgAttr::InlineStyleSrc)
+    auto it = list.begin();
+    for(; it != list.end() && it->src() != SvgAttr::CSSSrc; ++it) {
+      if(it->nameIs(attr.nameAtom()) && it->src() == SvgAttr::InlineStyleSrc)
         return replaceAttr(*it, attr);  // if already present as inline style, can't be a CSSSrc version
     }
-    it = attrs.insert(it, attr);
+    it = list.insert(it, attr);
     // remove CSSSrc attr is present
-    for(++it; it != attrs.end(); ++it) {
-      if(it->nameIs(attr.name()) && it->src() == SvgAttr::CSSSrc) {
-        attrs.erase(it);
+    for(++it; it != list.end(); ++it) {
+      if(it->nameIs(attr.nameAtom()) && it->src() == SvgAttr::CSSSrc) {
+        list.erase(it);
         break;
       }
     }
   }
+  attrs.markPresent(attr.stdAttr());
   return true;
 }
 
@@ -406,15 +867,20 @@ void SvgNode::removeAttr(const char* name, int src)
   //  since we remove all instances of attribute, those CSS attributes would be removed anyway, so we'll
   //  require user manually force restyle if desired
   // arguably, we should also restyle if needed before removing attributes!
-  size_t n = attrs.size();
-  for(auto it = attrs.begin(); it != attrs.end();)
-    it = it->nameIs(name) && (it->src() & src) ? attrs.erase(it) : ++it;
-  if(attrs.size() < n)
-    onAttrChange(name, SvgAttr::nameToStdAttr(name));  // this is OK for now since removeAttr is rarely used
+  if(!getAttr(name, src))
+    return;
+  SvgAttrList& list = attrs.mut();
+  for(auto it = list.begin(); it != list.end();)
+    it = it->nameIs(name) && (it->src() & src) ? list.erase(it) : ++it;
+  attrs.updateMask();
+  onAttrChange(name, SvgAttr::nameToStdAttr(name));  // this is OK for now since removeAttr is rarely used
 }
 
 const SvgAttr* SvgNode::getAttr(const char* name, int src) const
 {
+  SvgAttr::StdAttr stdattr = SvgAttr::nameToStdAttr(name);
+  if(stdattr != SvgAttr::UNKNOWN)
+    return getAttr(stdattr, src);
   for(auto it = attrs.rbegin(); it != attrs.rend(); ++it) {
     if(it->nameIs(name) && (it->src() & src))
       return &*it;
@@ -422,6 +888,23 @@ const SvgAttr* SvgNode::getAttr(const char* name, int src) const
   return NULL;
 }
 
+const SvgAttr* SvgNode::getAttr(SvgAttr::StdAttr stdattr, int src) const
+{
+  if(!attrs.mayContain(stdattr))
+    return NULL;
+  for(auto it = attrs.rbegin(); it != attrs.rend(); ++it) {
+    if(it->nameIs(stdattr) && (it->src() & src))
+      return &*it;
+  }
+  return NULL;
+}
+
+SvgAttr* SvgNode::mutableAttr(const SvgAttr* attr)
+{
+  size_t idx = attr - attrs.list().data();
+  return &attrs.mut()[idx];
+}
+
 int SvgNode::getIntAttr(const char* name, int dflt) const
 {
   const SvgAttr* attr = getAttr(name);
@@ -446,13 +929,40 @@ const char* SvgNode::getStringAttr(const char* name, const char* dflt) const
   return attr && attr->valueIs(SvgAttr::StringVal) ? attr->stringVal() : dflt;
 }
 
+int SvgNode::getIntAttr(SvgAttr::StdAttr stdattr, int dflt) const
+{
+  const SvgAttr* attr = getAttr(stdattr);
+  return attr && attr->valueIs(SvgAttr::IntVal) ? attr->intVal() : dflt;
+}
+
+Color SvgNode::getColorAttr(SvgAttr::StdAttr stdattr, color_t dflt) const
+{
+  const SvgAttr* attr = getAttr(stdattr);
+  return attr && attr->valueIs(SvgAttr::ColorVal) ? attr->colorVal() : dflt;
+}
+
+float SvgNode::getFloatAttr(SvgAttr::StdAttr stdattr, float dflt) const
+{
+  const SvgAttr* attr = getAttr(stdattr);
+  return attr && attr->valueIs(SvgAttr::FloatVal) ? attr->floatVal() : dflt;
+}
+
+const char* SvgNode::getStringAttr(SvgAttr::StdAttr stdattr, const char* dflt) const
+{
+  const SvgAttr* attr = getAttr(stdattr);
+  return attr && attr->valueIs(SvgAttr::StringVal) ? attr->stringVal() : dflt;
+}
+
 // convert CSS style attrs to inline style attrs, e.g., to allow for insertion into another document; note that
 //  a CSS attr is not added to node if overriding inline style attr is present, so all we have to do is change
 //  flags on CSS attrs
 void SvgNode::cssToInlineStyle()
 {
-  for(auto it = attrs.rbegin(); it != attrs.rend() && it->src() == SvgAttr::CSSSrc; ++it)
-    it->setFlags(it->getFlags() ^ (SvgAttr::CSSSrc | SvgAttr::InlineStyleSrc));
+  if(!attrs.empty() && attrs.back().src() == SvgAttr::CSSSrc) {
+    SvgAttrList& list = attrs.mut();
+    for(auto it = list.rbegin(); it != list.rend() && it->src() == SvgAttr::CSSSrc; ++it)
+      it->setFlags(it->getFlags() ^ (SvgAttr::CSSSrc | SvgAttr::InlineStyleSrc));
+  }
   if(asContainerNode()) {
     for(SvgNode* child : asContainerNode()->children())
       child->cssToInlineStyle();
@@ -493,9 +1003,8 @@ std::string SvgNode::nodePath(const SvgNode* node)
 size_t SvgNode::estimateMemoryUsage(SvgNode* node)
 {
   size_t nbytes = 0;
-  nbytes = sizeof(SvgNode) + node->attrs.size()*sizeof(SvgAttr);
-  for(auto it = node->attrs.begin(); it != node->attrs.end(); ++it)
-    nbytes += it->valueIs(SvgAttr::StringVal) ? it->stringLen() : 0;
+  // attribute names, ids, and classes are interned - see SvgAtom::tableMemoryUsage() for their storage
+  nbytes = sizeof(SvgNode) + node->attrs.memoryUsage() + node->m_classTokens.capacity()*sizeof(SvgAtom);
 
   if(node->asContainerNode()) {
     for(SvgNode* child : node->asContainerNode()->children()) {
@@ -504,12 +1013,17 @@ size_t SvgNode::estimateMemoryUsage(SvgNode* node)
   }
   switch(node->type()) {
     case PATH:
-      nbytes += sizeof(Path2D);
-      nbytes += static_cast<SvgPath*>(node)->path()->points.size()*sizeof(Point);
-      nbytes += static_cast<SvgPath*>(node)->path()->commands.size()*sizeof(Path2D::PathCommand);
+      nbytes += sizeof(Path2D) + static_cast<SvgPath*>(node)->m_pathData.size();
+      nbytes += static_cast<SvgPath*>(node)->m_path.points.size()*sizeof(Point);
+      nbytes += static_cast<SvgPath*>(node)->m_path.commands.size()*sizeof(Path2D::PathCommand);
       break;
     case IMAGE:
-      nbytes += sizeof(SvgImage) + static_cast<SvgImage*>(node)->image()->dataLen();
+      nbytes += sizeof(SvgImage) + static_cast<SvgImage*>(node)->m_image.dataLen();
+      if(static_cast<SvgImage*>(node)->m_encoded) {
+        SvgImage::EncodedImage* enc = static_cast<SvgImage*>(node)->m_encoded.get();
+        std::lock_guard<std::mutex> lock(enc->mutex);
+        nbytes += enc->data.size() + enc->image.dataLen();
+      }
       break;
     case TEXT:
     case TSPAN:
@@ -626,12 +1140,73 @@ SvgXmlFragment::SvgXmlFragment(const SvgXmlFragment& other) : SvgNode(other), fr
 
 // SvgContainerNode
 
+SvgContainerNode::SvgContainerNode(const SvgContainerNode& other) : SvgNode(other),
+    m_children(this, other.m_children), m_lazy(other.m_lazy ? new SvgLazyContent(*other.m_lazy) : NULL),
+    m_lazyPending(bool(m_lazy)) {}
+
+SvgContainerNode::~SvgContainerNode() {}
+
+// mutex of root document, so unrelated documents don't contend; recursive since parsing lazy content calls
+//  children() and may parse nested lazy content
+static std::recursive_mutex& lazyContentMutex(const SvgDocument* doc)
+{
+  static std::recursive_mutex detachedMutex;  // for nodes not in a document
+  SvgDocument* root = doc ? doc->rootDocument() : NULL;
+  return root ? root->m_lazyState.mutex : doc ? doc->m_lazyState.mutex : detachedMutex;
+}
+
+Rect SvgContainerNode::lazyBounds() const
+{
+  if(!isLazy())
+    return Rect();
+  std::lock_guard<std::recursive_mutex> lock(lazyContentMutex(document()));
+  return m_lazy ? m_lazy->bboxHint : Rect();
+}
+
+void SvgContainerNode::setLazyContent(SvgLazyContent* lazy)
+{
+  m_lazy.reset(lazy);
+  m_lazyPending.store(bool(m_lazy), std::memory_order_release);
+}
+
+static void removeLazyIds(SvgDocument* doc, const SvgContainerNode* node)
+{
+  for(const std::string& id : node->m_lazy->ids) {
+    auto it = doc->m_lazyIds.find(id);
+    if(it != doc->m_lazyIds.end() && it->second == node)
+      doc->m_lazyIds.erase(it);
+  }
+}
+
+void SvgContainerNode::parseLazyContent() const
+{
+  SvgDocument* doc = document();
+  std::lock_guard<std::recursive_mutex> lock(lazyContentMutex(doc));
+  if(!m_lazy)
+    return;  // parsed by another thread while we waited, or we are being parsed
+  if(doc)
+    removeLazyIds(doc, this);
+  std::unique_ptr<SvgLazyContent> lazy = std::move(m_lazy);  // so children() doesn't recurse
+  SvgParser::parseLazyContent(const_cast<SvgContainerNode*>(this), *lazy);
+  m_lazyPending.store(false, std::memory_order_release);
+  // once all ids have been added to m_namedNodes, namedNode() no longer needs lock
+  if(doc && doc->m_lazyIds.empty())
+    doc->m_lazyState.hasIds.store(false, std::memory_order_release);
+}
+
+// lazy content is not parsed here - its ids go in m_lazyIds instead
 static void addIds(SvgDocument* doc, SvgNode* node)
 {
   if(node->xmlId()[0])
     doc->addNamedNode(node);
-  if(node->asContainerNode()) {
-    for(SvgNode* child : node->asContainerNode()->children())
+  SvgContainerNode* container = node->asContainerNode();
+  if(container) {
+    if(container->m_lazy) {
+      for(const std::string& id : container->m_lazy->ids)
+        doc->m_lazyIds[id] = container;
+      doc->m_lazyState.hasIds.store(true, std::memory_order_release);
+    }
+    for(SvgNode* child : container->parsedChildren())
       addIds(doc, child);
   }
 }
@@ -640,8 +1215,11 @@ static void removeIds(SvgDocument* doc, SvgNode* node)
 {
   if(node->xmlId()[0])
     doc->removeNamedNode(node);
-  if(node->asContainerNode()) {
-    for(SvgNode* child : node->asContainerNode()->children())
+  SvgContainerNode* container = node->asContainerNode();
+  if(container) {
+    if(container->m_lazy)
+      removeLazyIds(doc, container);
+    for(SvgNode* child : container->parsedChildren())
       removeIds(doc, child);
   }
 }
@@ -657,8 +1235,8 @@ void SvgContainerNode::addChild(SvgNode* child, SvgNode* next)
   if(children().empty() || m_cachedBounds.isValid()) //&& !m_cachedBounds.contains(child->bounds()))
     invalidateBounds(false);
 
-  if(next)
-    children().insert(std::find(children().begin(), children().end(), next), child);
+  if(next && next->parent() == this && children().contains(next))
+    children().insert(SvgNodeList::iterator(&children(), next), child);
   else
     children().push_back(child);
 
@@ -671,8 +1249,7 @@ void SvgContainerNode::addChild(SvgNode* child, SvgNode* next)
 
 SvgNode* SvgContainerNode::removeChild(SvgNode* child)
 {
-  auto it = std::find(children().begin(), children().end(), child);
-  if(it == children().end())
+  if(child->parent() != this || !children().contains(child))
     return NULL;
 
   if(m_renderedBounds.isValid())
@@ -690,8 +1267,9 @@ SvgNode* SvgContainerNode::removeChild(SvgNode* child)
   if(doc)
     removeIds(doc, child);
   child->setParent(NULL);
-  auto next = children().erase(it);
-  return next != children().end() ? *next : NULL;
+  SvgNode* next = child->m_nextSibling;
+  children().remove(child);
+  return next;
 }
 
 // because CSS selectors can select children, we must restyle all children upon attribute change
@@ -700,7 +1278,8 @@ bool SvgContainerNode::restyle()
 #ifndef NO_DYNAMIC_STYLE
   if(!SvgNode::restyle())
     return false;
-  for(SvgNode* child : children())
+  // lazy content is styled when parsed
+  for(SvgNode* child : parsedChildren())
     child->restyle();
   return true;
 #endif
@@ -729,7 +1308,7 @@ void SvgContainerNode::invalidateBounds(bool inclChildren, bool inclParents) con
 {
   SvgNode::invalidateBounds(inclChildren, inclParents);
   if(inclChildren) {
-    for(SvgNode* node : children())
+    for(SvgNode* node : parsedChildren())
       node->invalidateBounds(true, false);
   }
 }
@@ -772,10 +1351,10 @@ Gradient& SvgGradient::gradient() const
     real offset = 0;
     for(SvgGradientStop* child : stops()) {
       SvgGradientStop* svgstop = static_cast<SvgGradientStop*>(child);
-      offset = std::min(std::max((real)svgstop->getFloatAttr("offset", 0), offset), 1.0);
-      Color color = svgstop->getColorAttr("stop-color", Color::BLACK);
+      offset = std::min(std::max((real)svgstop->getFloatAttr(SvgAttr::OFFSET, 0), offset), 1.0);
+      Color color = svgstop->getColorAttr(SvgAttr::STOP_COLOR, Color::BLACK);
       // support stop-color w/ alpha < 1
-      color.setAlphaF(color.alphaF() * svgstop->getFloatAttr("stop-opacity", 1.0));
+      color.setAlphaF(color.alphaF() * svgstop->getFloatAttr(SvgAttr::STOP_OPACITY, 1.0));
       m_gradient.addStop(offset, color);
     }
     ++m_generation;
@@ -787,9 +1366,30 @@ Gradient& SvgGradient::gradient() const
 
 SvgPainter* SvgDocument::sharedBoundsCalc = NULL;
 
+SvgPainter* SvgDocument::defaultBoundsCalc()
+{
+  if(sharedBoundsCalc)
+    return sharedBoundsCalc;
+  // per-thread, so documents being processed on different threads don't contend for a single calculator
+  struct ThreadBoundsCalc {
+    Painter painter;
+    SvgPainter bounder;
+    ThreadBoundsCalc() : painter(Painter::PAINT_NULL), bounder(&painter) {}
+  };
+  static thread_local ThreadBoundsCalc calc;
+  return &calc.bounder;
+}
+
 SvgDocument::SvgDocument(real x, real y, SvgLength w, SvgLength h)
     : m_x(x), m_y(y), m_width(w), m_height(h) {}  //boundsCalculator(sharedBoundsCalc)
 
+// arena is deleted after children are, when last block is freed
+SvgDocument::~SvgDocument()
+{
+  if(m_arena)
+    m_arena->release();
+}
+
 SvgDocument* SvgDocument::clone() const
 {
   ASSERT(m_fonts.empty() && "Cloning SvgDocument with fonts not yet supported");
@@ -797,10 +1397,12 @@ SvgDocument* SvgDocument::clone() const
 //  ASSERT(!m_stylesheet && "Cloning SvgDocument with stylesheet not yet supported");
 //#endif
   SvgDocument* c = new SvgDocument(*this);
+  c->m_arena = NULL;
   //c->m_stylesheet = NULL;
   c->m_fonts.clear();
-  if(!c->m_namedNodes.empty()) {
+  if(!c->m_namedNodes.empty() || !c->m_lazyIds.empty()) {
     c->m_namedNodes.clear();
+    c->m_lazyIds.clear();
     addIds(c, c);
   }
   return c;
@@ -809,10 +1411,10 @@ SvgDocument* SvgDocument::clone() const
 // note that newid must include leading '#'
 static void replaceId(SvgNode* node, const char* oldid, const char* newid)
 {
-  const char* fillref = node->getStringAttr("fill");
+  const char* fillref = node->getStringAttr(SvgAttr::FILL);
   if(fillref && strcmp(fillref+1, oldid) == 0)
     node->setAttr("fill", newid);
-  const char* strokeref = node->getStringAttr("stroke");
+  const char* strokeref = node->getStringAttr(SvgAttr::STROKE);
   if(strokeref && strcmp(strokeref+1, oldid) == 0)
     node->setAttr("stroke", newid);
   const char* href = node->getStringAttr("xlink:href");  // we should do "href" too
@@ -918,8 +1520,8 @@ SvgFont* SvgDocument::svgFont(const char* family, int weight, int style) const
   if(std::distance(hits.first, hits.second) == 1)
     return const_cast<SvgFont*>(hits.first->second);
   for(auto hit = hits.first; hit != hits.second; ++hit) {
-    if(hit->second->fontFace()->getIntAttr("font-weight", 400) == weight
-        && hit->second->fontFace()->getIntAttr("font-style", Painter::StyleNormal) == style)
+    if(hit->second->fontFace()->getIntAttr(SvgAttr::FONT_WEIGHT, 400) == weight
+        && hit->second->fontFace()->getIntAttr(SvgAttr::FONT_STYLE, Painter::StyleNormal) == style)
       return const_cast<SvgFont*>(hit->second);
   }
   if(hits.first != hits.second)
@@ -949,7 +1551,19 @@ void SvgDocument::removeNamedNode(SvgNode* node)
 SvgNode* SvgDocument::namedNode(const char* id) const
 {
   SvgDocument* parent_doc;
-  auto it = m_namedNodes.find(id[0] == '#' ? id + 1 : id);
+  const char* key = id[0] == '#' ? id + 1 : id;
+  // lazy content may be parsed (adding to m_namedNodes) on another thread
+  std::unique_lock<std::recursive_mutex> lock;
+  if(m_lazyState.hasIds.load(std::memory_order_acquire))
+    lock = std::unique_lock<std::recursive_mutex>(lazyContentMutex(this));
+  auto it = m_namedNodes.find(key);
+  if(it == m_namedNodes.end() && !m_lazyIds.empty()) {
+    auto lazyit = m_lazyIds.find(key);
+    if(lazyit != m_lazyIds.end()) {
+      lazyit->second->parseLazyContent();  // adds ids of content to m_namedNodes
+      it = m_namedNodes.find(key);
+    }
+  }
   if(it == m_namedNodes.end() && m_parent && (parent_doc = m_parent->document())) {
     //if(IS_DEBUG) ASSERT(!parent_doc->namedNode(id) && "named node found on parent!");
     return parent_doc->namedNode(id);
@@ -960,7 +1574,7 @@ SvgNode* SvgDocument::namedNode(const char* id) const
 #ifndef NO_DYNAMIC_STYLE
 //SvgDocument::~SvgDocument() { if(m_stylesheet) delete m_stylesheet; }
 // caller should call restyle() after setting stylesheet (after adding styles and calling sort_rules())
-void SvgDocument::setStylesheet(std::shared_ptr<SvgCssStylesheet> ss) { m_stylesheet = ss; }
+void SvgDocument::setStylesheet(std::shared_ptr<const SvgCssStylesheet> ss) { m_stylesheet = std::move(ss); }
 #endif
 
 // behavior here is not consistent with Chrome or Firefox - they seem to merge all <style>s into
@@ -991,15 +1605,132 @@ bool SvgDocument::canRestyle()
 SvgImage::SvgImage(Image image, const Rect& bounds, const char* linkStr)
     : m_image(std::move(image)), m_bounds(bounds), m_linkStr(linkStr ? linkStr : "") {}
 
-SvgImage::SvgImage(const SvgImage& other) : SvgNode(other), m_image(other.m_image.copy()),
-    m_bounds(other.m_bounds), m_linkStr(other.m_linkStr), srcRect(other.srcRect) {}
+SvgImage::SvgImage(std::vector<unsigned char> encoded, const Rect& bounds, const char* linkStr)
+    : m_image(0, 0), m_encoded(std::make_shared<EncodedImage>(std::move(encoded))), m_bounds(bounds),
+      m_linkStr(linkStr ? linkStr : "") {}
+
+SvgImage::SvgImage(const SvgImage& other) : SvgNode(other), m_image(0, 0),
+    m_bounds(other.m_bounds), m_linkStr(other.m_linkStr), srcRect(other.srcRect)
+{
+  if(other.m_encoded) {
+    EncodedImage* enc = other.m_encoded.get();
+    std::lock_guard<std::mutex> lock(enc->mutex);
+    if(enc->decoded && enc->data.empty())
+      m_image = enc->image.copy();
+    else
+      m_encoded = std::make_shared<EncodedImage>(enc->data);
+  }
+  else
+    m_image = other.m_image.copy();
+}
+
+void SvgImage::EncodedImage::decode()
+{
+  if(decoded)
+    return;
+  image = Image::decodeBuffer(data.data(), data.size());
+  // data is kept if image can't be decoded so that it can be saved
+  if(image.width > 0 && image.height > 0) {
+    data.clear();
+    data.shrink_to_fit();
+  }
+  decoded = true;
+}
+
+void SvgImage::decodeImage() const
+{
+  {
+    std::lock_guard<std::mutex> lock(m_encoded->mutex);
+    m_encoded->decode();
+    m_image = std::move(m_encoded->image);
+    // image w/o link (i.e. from data URI) keeps invalid data so it can be saved
+    if(!m_encoded->data.empty() && m_linkStr.empty())
+      return;
+  }
+  m_encoded.reset();
+}
+
+// one pool of threads shared by all documents; destroyed (after main returns) by stopping and joining threads,
+//  abandoning any queued decodes
+class ImageDecodePool
+{
+public:
+  typedef std::shared_ptr<SvgImage::EncodedImage> EncodedPtr;
+
+  static ImageDecodePool& instance() { static ImageDecodePool pool;  return pool; }
+
+  void push(std::vector<EncodedPtr>& images)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for(EncodedPtr& enc : images)
+        queue.push_back(std::move(enc));
+      // threads are started as needed, up to one per core
+      size_t nthreads = std::min(size_t(std::max(1u, std::thread::hardware_concurrency())), queue.size());
+      while(threads.size() < nthreads)
+        threads.emplace_back([this](){ run(); });
+    }
+    cond.notify_all();
+  }
+
+  ~ImageDecodePool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+      queue.clear();
+    }
+    cond.notify_all();
+    for(std::thread& t : threads)
+      t.join();
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<EncodedPtr> queue;
+  std::vector<std::thread> threads;
+  bool stop = false;
+
+  void run()
+  {
+    for(;;) {
+      EncodedPtr enc;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this](){ return stop || !queue.empty(); });
+        if(stop)
+          return;
+        enc = std::move(queue.front());
+        queue.pop_front();
+      }
+      // skip if image node has been deleted or image() has already been called
+      if(enc.use_count() > 1) {
+        std::lock_guard<std::mutex> lock(enc->mutex);
+        enc->decode();
+      }
+    }
+  }
+};
+
+void SvgImage::decodeInBackground(const std::vector<SvgImage*>& images)
+{
+  // pool holds references to the encoded data, so document can be deleted at any time
+  std::vector<ImageDecodePool::EncodedPtr> queue;
+  for(SvgImage* img : images) {
+    if(img->m_encoded)
+      queue.push_back(img->m_encoded);
+  }
+  if(!queue.empty())
+    ImageDecodePool::instance().push(queue);
+}
 
 Rect SvgImage::viewport() const
 {
   real w = m_bounds.width(), h = m_bounds.height();
-  real imgw = m_image.getWidth(), imgh = m_image.getHeight();
   if(w > 0 && h > 0)
     return m_bounds;
+  real imgw = image()->getWidth(), imgh = image()->getHeight();
   if(imgw <= 0 || imgh <= 0)
     return m_bounds;  // not much else we can do if image is missing
   if(w <= 0 && h <= 0)
@@ -1012,6 +1743,22 @@ Rect SvgImage::viewport() const
 
 // SvgPath / SvgRect
 
+// points is scratch space so caller can reuse it for multiple paths
+void SvgPath::parsePathData(std::vector<real>& points) const
+{
+  ::parsePathData(StringRef(m_pathData.data(), m_pathData.size()), m_path, points);
+  m_pathData.clear();
+  m_pathData.shrink_to_fit();
+  m_unparsed.store(false, std::memory_order_release);
+}
+
+void SvgPath::parseLazyPath() const
+{
+  std::lock_guard<std::recursive_mutex> lock(lazyContentMutex(document()));
+  if(m_unparsed.load(std::memory_order_relaxed))  // not parsed by another thread while we waited
+    parsePathData();
+}
+
 // rect (incl. rounded rects) are key GUI elements, thus we will separate from SvgPath
 
 SvgRect::SvgRect(const Rect& rect, real rx, real ry) : SvgPath(RECT), m_rect(rect), m_rx(rx), m_ry(ry)
@@ -1090,6 +1837,9 @@ void SvgRect::updatePath()
 SvgUse::SvgUse(const Rect& bounds, const char* linkStr, const SvgNode* node, SvgDocument* doc)
   : m_link(node), m_viewport(bounds), m_linkStr(linkStr), m_doc(doc) {}
 
+SvgUse::SvgUse(const Rect& bounds, const char* linkStr, const SvgNode* node, std::shared_ptr<SvgDocument> doc)
+  : m_link(node), m_viewport(bounds), m_linkStr(linkStr), m_doc(std::move(doc)) {}
+
 // NOTE: m_link is only used if m_link == m_doc or if set by setTarget() - otherwise, target is resolved
 //  every time target() is called (so, e.g., we don't get crashes if target node is removed)
 const SvgNode* SvgUse::target() const
@@ -1110,6 +1860,15 @@ void SvgUse::setTarget(const SvgNode* link, std::shared_ptr<SvgDocument> doc)
   }
 }
 
+void SvgUse::setExternalDoc(std::shared_ptr<SvgDocument> doc, const char* id)
+{
+  m_doc = std::move(doc);
+  if(id)
+    m_linkStr = id;
+  m_link = id ? NULL : m_doc.get();
+  invalidate(false);
+}
+
 // SvgText / SvgTspan
 
 bool SvgTspan::restyle()
@@ -1,9 +1,13 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <memory>
-#include <list>
+#include <atomic>
+#include <cstring>
+#include <iterator>
 #include <unordered_map>
+#include <mutex>
 #include "ulib/path2d.h"
 #include "ulib/image.h"
 #include "ulib/color.h"  // for Color and Gradient
@@ -18,6 +22,107 @@ class SvgDocument;
 class SvgPainter;
 class SvgWriter;
 
+// optional per-document allocator for nodes and attribute storage (see SvgParser::ArenaAlloc): blocks are bump
+//  allocated from large chunks, freed blocks are reused via size-class free lists, and all chunks are released at
+//  once when the owning document has been deleted and no blocks remain in use.  Chunks are aligned to their size
+//  and registered in a global table, so the arena owning a block is found from its address and memory can be freed
+//  after moving to another document or when no arena is current (allocations made with no current arena go to the
+//  heap).  Until an arena is first created, alloc() and dealloc() are just the heap.  Deleting a document still
+//  destroys and frees each node individually.  Blocks are 8-byte aligned.  Not thread-safe, like SvgDocument
+class SvgArena
+{
+public:
+  SvgArena() { used.store(true, std::memory_order_relaxed); }
+  static void* alloc(size_t size);
+  static void dealloc(void* p, size_t size);
+  // arena that p (returned by alloc()) came from, or NULL if from the heap
+  static SvgArena* owner(const void* p);
+  static bool fromArena(const void* p) { return owner(p) != NULL; }
+  // for use by owner; arena is deleted once released and empty
+  void release() { m_released = true;  if(m_nblocks == 0) delete this; }
+
+  static thread_local SvgArena* current;
+  static std::atomic<bool> used;  // set once any arena is created
+  struct Scope {
+    SvgArena* prev;
+    Scope(SvgArena* arena) : prev(current) { current = arena; }
+    ~Scope() { current = prev; }
+  };
+
+  static constexpr size_t CHUNK_SIZE = 64*1024;
+  static constexpr size_t MAX_BLOCK = 1024;  // larger blocks are allocated from heap
+  static constexpr size_t GRAIN = 8;
+
+private:
+  struct FreeBlock { FreeBlock* next; };
+
+  std::vector<char*> m_chunks;
+  char* m_next = NULL;
+  char* m_end = NULL;
+  FreeBlock* m_freeLists[MAX_BLOCK/GRAIN + 1] = {};
+  size_t m_nblocks = 0;
+  bool m_released = false;
+
+  ~SvgArena();
+  void* allocBlock(size_t nbytes);
+  void freeBlock(void* block, size_t nbytes);
+};
+
+// stateless, so containers can exchange storage freely; storage is taken from SvgArena::current when allocated
+template<typename T>
+struct SvgArenaAllocator
+{
+  typedef T value_type;
+  SvgArenaAllocator() {}
+  template<typename U> SvgArenaAllocator(const SvgArenaAllocator<U>&) {}
+  T* allocate(size_t n) { return static_cast<T*>(SvgArena::alloc(n*sizeof(T))); }
+  void deallocate(T* p, size_t n) { SvgArena::dealloc(p, n*sizeof(T)); }
+  friend bool operator==(const SvgArenaAllocator&, const SvgArenaAllocator&) { return true; }
+  friend bool operator!=(const SvgArenaAllocator&, const SvgArenaAllocator&) { return false; }
+};
+
+// interned, refcounted string: all SvgAtoms for equal strings share one entry in a global table, so comparison
+//  is pointer equality and each string is stored once; entry is freed when last SvgAtom referencing it is
+//  destroyed (atoms for standard attribute names are never freed).  Empty string is represented by NULL entry.
+//  Table is sharded by hash w/ a lock per shard.  Note that CSS selector matching still compares class names w/
+//  strcmp, via SvgNode::hasClass(const char*), since selectors hold plain strings
+class SvgAtom
+{
+public:
+  SvgAtom() {}
+  explicit SvgAtom(const char* s) : SvgAtom(s, strlen(s)) {}
+  SvgAtom(const char* s, size_t len) : e(len > 0 ? intern(s, len) : NULL) {}
+  explicit SvgAtom(const std::string& s) : SvgAtom(s.data(), s.size()) {}
+  SvgAtom(const SvgAtom& other) : e(other.e) { if(e && !e->immortal) e->refs.fetch_add(1, std::memory_order_relaxed); }
+  SvgAtom(SvgAtom&& other) noexcept : e(other.e) { other.e = NULL; }
+  SvgAtom& operator=(SvgAtom other) { std::swap(e, other.e);  return *this; }
+  ~SvgAtom() { if(e && !e->immortal) release(e); }
+
+  const char* c_str() const { return e ? e->str : ""; }
+  size_t size() const { return e ? e->len : 0; }
+  bool empty() const { return !e; }
+  friend bool operator==(const SvgAtom& a, const SvgAtom& b) { return a.e == b.e; }
+  friend bool operator!=(const SvgAtom& a, const SvgAtom& b) { return a.e != b.e; }
+
+  // number of distinct strings and total bytes used by table
+  static size_t tableSize();
+  static size_t tableMemoryUsage();
+
+private:
+  struct Entry {
+    std::atomic<int> refs;
+    bool immortal;
+    uint8_t shard;  // index of table shard holding entry
+    size_t len;
+    char str[1];  // allocated to len + 1
+  };
+  Entry* e = NULL;
+
+  static Entry* intern(const char* s, size_t len, bool immortal = false);
+  static void release(Entry* e);
+  friend class SvgAttr;
+};
+
 class SvgAttr
 {
 public:
@@ -27,6 +132,7 @@ public:
     STROKE_WIDTH, TEXT_ANCHOR, VECTOR_EFFECT, VISIBILITY, LETTER_SPACING, STROKE_ALIGNMENT };
 
   static StdAttr nameToStdAttr(const char* name);
+  static const SvgAtom& stdAttrAtom(StdAttr stdattr);
 
   enum ExFlags { NoExFlags = 0, Stale = 0x10000, NoSerialize = 0x20000, Variable = 0x40000, Inherit = 0x80000 };
   bool isStale() const { return flags & Stale; }
@@ -40,45 +146,73 @@ public:
   SvgAttr& setFlags(unsigned int f) { flags = f | valueType(); return *this; }
   unsigned int getFlags() const { return flags; }
 
-  const char* name() const { return str.c_str(); }
+  const char* name() const { return m_name.c_str(); }
+  const SvgAtom& nameAtom() const { return m_name; }
   bool nameIs(const char* s) const;
   bool nameIs(StdAttr std) const { return stdAttr() == std; }
+  bool nameIs(const SvgAtom& atom) const { return m_name == atom; }
 
   enum ValueType { IntVal = 0x100, ColorVal = 0x200, FloatVal = 0x300, StringVal = 0x400 };
   ValueType valueType() const { return ValueType(flags & 0x0F00); }
   bool valueIs(ValueType type) const { return valueType() == type; }
   friend bool operator==(const SvgAttr& a, const SvgAttr& b);
+  size_t hash() const;
 
   int intVal() const { return value.intVal; }
   color_t colorVal() const { return value.colorVal; }
   float floatVal() const { return value.floatVal; }
-  const char* stringVal() const { return str.data() + value.strOffset; }
-  size_t stringLen() const { return str.size() - value.strOffset; }
+  const char* stringVal() const { return value.strVal; }
+  size_t stringLen() const { return strLen; }
 
-  SvgAttr(const char* n, int v, int f = XMLSrc) : str(n), flags(f | IntVal) { value.intVal = v; }
-  SvgAttr(const char* n, color_t v, int f = XMLSrc) : str(n), flags(f | ColorVal) { value.colorVal = v; }
-  SvgAttr(const char* n, float v, int f = XMLSrc) : str(n), flags(f | FloatVal) { value.floatVal = v; }
-  SvgAttr(const char* n, double v, int f = XMLSrc) : str(n), flags(f | FloatVal) { value.floatVal = v; }
+  SvgAttr(const char* n, int v, int f = XMLSrc) : SvgAttr(InitName(), n, f | IntVal) { value.intVal = v; }
+  SvgAttr(const char* n, color_t v, int f = XMLSrc) : SvgAttr(InitName(), n, f | ColorVal) { value.colorVal = v; }
+  SvgAttr(const char* n, float v, int f = XMLSrc) : SvgAttr(InitName(), n, f | FloatVal) { value.floatVal = v; }
+  SvgAttr(const char* n, double v, int f = XMLSrc) : SvgAttr(InitName(), n, f | FloatVal) { value.floatVal = v; }
   //SvgAttr(const char* n, void* v, int f = XMLSrc) : str(n), flags(f | PtrVal) { value.ptrVal = v; }
-  SvgAttr(const char* n, const char* v, int f = XMLSrc) : str(n), flags(f | StringVal)
-    { str += '\0';  value.strOffset = str.size();  str += v; }
+  SvgAttr(const char* n, const char* v, int f = XMLSrc) : SvgAttr(n, (const void*)v, strlen(v), f) {}
   // Previously, we made hack of storing arbitrary data in str official but this is dangerous because we
   //  can't guarantee proper alignment - so we'll force the only use case, stroke-dasharray, to use
   //  stringVal to make 1-byte alignment explicit
-  SvgAttr(const char* n, const void* v, size_t len, int f = XMLSrc) : str(n), flags(f | StringVal)
-    { str += '\0';  value.strOffset = str.size();  str.append((const char*)v, len); }
+  SvgAttr(const char* n, const void* v, size_t len, int f = XMLSrc) : SvgAttr(InitName(), n, f | StringVal)
+    { setString(v, len); }
+  SvgAttr(const SvgAttr& other) : m_name(other.m_name), value(other.value), strLen(other.strLen), flags(other.flags)
+    { if(valueIs(StringVal)) setString(other.value.strVal, other.strLen); }
+  SvgAttr(SvgAttr&& other) noexcept : m_name(std::move(other.m_name)), value(other.value), strLen(other.strLen),
+      flags(other.flags) { other.value.strVal = NULL;  other.strLen = 0; }
+  SvgAttr& operator=(SvgAttr other) { swap(other);  return *this; }
+  ~SvgAttr() { if(valueIs(StringVal)) SvgArena::dealloc(value.strVal, strLen + 1); }
+
+  void swap(SvgAttr& other)
+  {
+    std::swap(m_name, other.m_name);
+    std::swap(value, other.value);
+    std::swap(strLen, other.strLen);
+    std::swap(flags, other.flags);
+  }
 
 private:
-  // str stores name and, if present, string value; std::string is 24-32 bytes, char* is 8 bytes, so not much
-  //  benefit to deduping name; for Write, path data completely dominates svg memory use
-  std::string str;
+  // sets name and flags; StdAttr id is always set for standard names, which are found w/o locking atom table
+  struct InitName {};
+  SvgAttr(InitName, const char* n, int f);
+
+  // name is interned, so only value strings are stored per attribute (null terminated, from current SvgArena)
+  SvgAtom m_name;
   union {
     int intVal;
     color_t colorVal;
     float floatVal;
-    unsigned int strOffset;
+    char* strVal;
   } value;
+  unsigned int strLen = 0;
   unsigned int flags;  // source (XML, CSS, style=), value type, standard attribute id
+
+  void setString(const void* v, size_t len)
+  {
+    strLen = len;
+    value.strVal = static_cast<char*>(SvgArena::alloc(len + 1));
+    memcpy(value.strVal, v, len);
+    value.strVal[len] = '\0';
+  }
 };
 
 class SvgLength {
@@ -125,6 +259,75 @@ protected:
 };
 
 
+typedef std::vector< SvgAttr, SvgArenaAllocator<SvgAttr> > SvgAttrList;
+
+// attributes of a node; the block of attributes can be shared by any number of nodes: copying a node shares its
+//  block, and share() replaces the block with an equal one from a global hash-consing table (see
+//  SvgParser::SharedAttrs).  Shared blocks are immutable, so mut() makes a private copy if needed (copy on write).
+//  A block allocated from an SvgArena is copied instead of shared, since arenas are not thread-safe and the copy
+//  may be used (and freed) on another thread; interned blocks are always allocated from the heap
+class SvgAttrSet
+{
+public:
+  typedef SvgAttrList::const_iterator const_iterator;
+  typedef const_iterator iterator;
+  typedef SvgAttrList::const_reverse_iterator const_reverse_iterator;
+  typedef const_reverse_iterator reverse_iterator;
+
+  SvgAttrSet() {}
+  SvgAttrSet(const SvgAttrSet& other);
+  SvgAttrSet(SvgAttrSet&& other) noexcept : b(other.b), m_mask(other.m_mask) { other.b = NULL;  other.m_mask = 0; }
+  SvgAttrSet& operator=(SvgAttrSet other) { std::swap(b, other.b);  std::swap(m_mask, other.m_mask);  return *this; }
+  SvgAttrSet& operator=(SvgAttrList&& list) { mut() = std::move(list);  updateMask();  return *this; }
+  ~SvgAttrSet() { if(b) release(b); }
+
+  const SvgAttrList& list() const { return b ? b->attrs : emptyList; }
+  const_iterator begin() const { return list().begin(); }
+  const_iterator end() const { return list().end(); }
+  const_reverse_iterator rbegin() const { return list().rbegin(); }
+  const_reverse_iterator rend() const { return list().rend(); }
+  size_t size() const { return list().size(); }
+  bool empty() const { return list().empty(); }
+  const SvgAttr& operator[](size_t ii) const { return list()[ii]; }
+  const SvgAttr& back() const { return list().back(); }
+
+  // returns attributes for modification, copying them first if shared; updateMask() or markPresent() must be
+  //  called if attributes are added (SvgNode::setAttr() does this)
+  SvgAttrList& mut();
+  // presence mask of standard attributes: may include attributes removed since last updateMask()
+  bool mayContain(SvgAttr::StdAttr stdattr) const { return m_mask & (1u << stdattr); }
+  void markPresent(SvgAttr::StdAttr stdattr) { m_mask |= 1u << stdattr; }
+  void updateMask();
+  // block is in hash-consing table (it may or may not be used by other nodes)
+  bool isInterned() const { return b && b->interned; }
+  // mut() would make a copy
+  bool isShared() const { return b && (b->interned || b->refs.load(std::memory_order_acquire) > 1); }
+  void share();
+  // bytes used, w/ shared block divided between its users
+  size_t memoryUsage() const;
+
+  static size_t tableSize();
+
+private:
+  struct Block {
+    std::atomic<int> refs{1};
+    bool interned = false;
+    size_t hash = 0;
+    SvgAttrList attrs;
+
+    Block() {}
+    Block(const SvgAttrList& a) : attrs(a) {}
+    static void* operator new(size_t size) { return SvgArena::alloc(size); }
+    static void operator delete(void* p, size_t size) { SvgArena::dealloc(p, size); }
+  };
+  Block* b = NULL;
+  uint32_t m_mask = 0;  // bit n set if attribute w/ StdAttr n is present
+  static_assert(SvgAttr::STROKE_ALIGNMENT < 32, "StdAttr values must fit in presence mask");
+
+  static const SvgAttrList emptyList;
+  static void release(Block* block);
+};
+
 class SvgNode
 {
 public:
@@ -143,6 +346,8 @@ public:
 
   SvgNode() {}
   virtual ~SvgNode();
+  static void* operator new(size_t size) { return SvgArena::alloc(size); }
+  static void operator delete(void* p, size_t size) { SvgArena::dealloc(p, size); }
   void deleteFromExt();
 
   SvgNode* parent() const { return m_parent; }
@@ -179,6 +384,7 @@ public:
   const char* xmlClass() const { return m_class.c_str(); }
   void setXmlClass(const char* str);
   bool hasClass(const char* s) const;
+  bool hasClass(const SvgAtom& cls) const;
   void addClass(const char* s);
   void removeClass(const char* s);
 
@@ -191,10 +397,18 @@ public:
   void removeAttr(const char* name, int src = SvgAttr::AnySrc);
 
   const SvgAttr* getAttr(const char* name, int src = SvgAttr::AnySrc) const;
+  // standard attributes are looked up by id, returning immediately if not present on node
+  const SvgAttr* getAttr(SvgAttr::StdAttr stdattr, int src = SvgAttr::AnySrc) const;
+  // returns modifiable attr given attr from getAttr(); copies attributes first if shared
+  SvgAttr* mutableAttr(const SvgAttr* attr);
   int getIntAttr(const char* name, int dflt = INT_MIN) const;
   Color getColorAttr(const char* name, color_t dflt = Color::INVALID_COLOR) const;
   float getFloatAttr(const char* name, float dflt = NAN) const;
   const char* getStringAttr(const char* name, const char* dflt = NULL) const;
+  int getIntAttr(SvgAttr::StdAttr stdattr, int dflt = INT_MIN) const;
+  Color getColorAttr(SvgAttr::StdAttr stdattr, color_t dflt = Color::INVALID_COLOR) const;
+  float getFloatAttr(SvgAttr::StdAttr stdattr, float dflt = NAN) const;
+  const char* getStringAttr(SvgAttr::StdAttr stdattr, const char* dflt = NULL) const;
   SvgNode* getRefTarget(const char* id) const;
   void cssToInlineStyle();
 
@@ -208,7 +422,7 @@ public:
   bool hasExt() const { return bool(m_ext); }
 
 //private:
-  std::vector<SvgAttr> attrs;
+  SvgAttrSet attrs;
   std::unique_ptr<Transform2D> transform;  // prior to SVG 2, transform is not a presentation attribute
 
   mutable Rect m_cachedBounds;
@@ -219,8 +433,13 @@ public:
   std::unique_ptr<SvgNodeExtension> m_ext;
   bool m_visible = true;
   DisplayMode m_displayMode = BlockMode;
-  std::string m_id;
-  std::string m_class;
+  SvgAtom m_id;
+  SvgAtom m_class;
+  std::vector<SvgAtom> m_classTokens;  // only set if m_class has more than one token
+  SvgNode* m_prevSibling = NULL;  // links for parent's SvgNodeList
+  SvgNode* m_nextSibling = NULL;
+
+  void setClassAtom(SvgAtom cls);  // no restyle
 
 protected:
   SvgNode(const SvgNode&);
@@ -250,6 +469,109 @@ public:
   SvgCustomNode* clone() const override { return new SvgCustomNode(*this); }
 };
 
+// intrusive doubly linked list of nodes using SvgNode::m_prevSibling and m_nextSibling - no allocation per
+//  node, O(1) insertion and removal at a known node, and iteration touches only the nodes themselves; a node can
+//  be in at most one list at a time.  Elements are not owned (see cloning_container) and cannot be assigned via
+//  iterator, so iterator is also const_iterator
+class SvgNodeList
+{
+public:
+  class iterator
+  {
+  public:
+    typedef std::bidirectional_iterator_tag iterator_category;
+    typedef SvgNode* value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef SvgNode* const* pointer;
+    typedef SvgNode* reference;  // by value so std::reverse_iterator doesn't return reference to temporary
+
+    iterator(const SvgNodeList* list = NULL, SvgNode* node = NULL) : m_list(list), m_node(node) {}
+    SvgNode* operator*() const { return m_node; }
+    iterator& operator++() { m_node = m_node->m_nextSibling;  return *this; }
+    iterator operator++(int) { iterator it = *this;  ++*this;  return it; }
+    iterator& operator--() { m_node = m_node ? m_node->m_prevSibling : m_list->m_last;  return *this; }
+    iterator operator--(int) { iterator it = *this;  --*this;  return it; }
+    bool operator==(const iterator& other) const { return m_node == other.m_node; }
+    bool operator!=(const iterator& other) const { return m_node != other.m_node; }
+
+  private:
+    const SvgNodeList* m_list;
+    SvgNode* m_node;
+    friend class SvgNodeList;
+  };
+  typedef iterator const_iterator;
+  typedef std::reverse_iterator<iterator> reverse_iterator;
+  typedef reverse_iterator const_reverse_iterator;
+  typedef SvgNode* value_type;
+
+  SvgNodeList() {}
+  SvgNodeList(const SvgNodeList&) = delete;
+
+  iterator begin() const { return iterator(this, m_first); }
+  iterator end() const { return iterator(this, NULL); }
+  iterator cbegin() const { return begin(); }
+  iterator cend() const { return end(); }
+  reverse_iterator rbegin() const { return reverse_iterator(end()); }
+  reverse_iterator rend() const { return reverse_iterator(begin()); }
+  reverse_iterator crbegin() const { return rbegin(); }
+  reverse_iterator crend() const { return rend(); }
+
+  bool empty() const { return !m_first; }
+  size_t size() const { return m_size; }
+  SvgNode* front() const { return m_first; }
+  SvgNode* back() const { return m_last; }
+  bool contains(const SvgNode* node) const
+    { return node->m_prevSibling ? node->m_prevSibling->m_nextSibling == node : m_first == node; }
+
+  void push_back(SvgNode* node) { insert(end(), node); }
+  // insert node before pos
+  iterator insert(iterator pos, SvgNode* node)
+  {
+    SvgNode* next = pos.m_node;
+    SvgNode* prev = next ? next->m_prevSibling : m_last;
+    node->m_prevSibling = prev;
+    node->m_nextSibling = next;
+    (prev ? prev->m_nextSibling : m_first) = node;
+    (next ? next->m_prevSibling : m_last) = node;
+    ++m_size;
+    return iterator(this, node);
+  }
+  // returns iterator to node following removed node
+  iterator erase(iterator pos)
+  {
+    SvgNode* node = pos.m_node;
+    SvgNode* next = node->m_nextSibling;
+    (node->m_prevSibling ? node->m_prevSibling->m_nextSibling : m_first) = next;
+    (next ? next->m_prevSibling : m_last) = node->m_prevSibling;
+    node->m_prevSibling = node->m_nextSibling = NULL;
+    --m_size;
+    return iterator(this, next);
+  }
+  void remove(SvgNode* node) { erase(iterator(this, node)); }
+  // unlinks all nodes; does not delete them
+  void clear()
+  {
+    for(SvgNode* node = m_first; node;) {
+      SvgNode* next = node->m_nextSibling;
+      node->m_prevSibling = node->m_nextSibling = NULL;
+      node = next;
+    }
+    m_first = m_last = NULL;
+    m_size = 0;
+  }
+  void swap(SvgNodeList& other)
+  {
+    std::swap(m_first, other.m_first);
+    std::swap(m_last, other.m_last);
+    std::swap(m_size, other.m_size);
+  }
+
+private:
+  SvgNode* m_first = NULL;
+  SvgNode* m_last = NULL;
+  size_t m_size = 0;
+};
+
 // this eliminates redundant, error-prone code w/o forcing us to unwrap smart pointers every place we iterate
 template<typename T>
 struct cloning_container
@@ -259,23 +581,27 @@ struct cloning_container
   cloning_container(const cloning_container& other) = delete;
   cloning_container(SvgNode* newparent, const cloning_container& other)
   {
-    //c.reserve(other.c.size()); -- not avail for list
-    for(auto& ptr : other.c) {
+    //c.reserve(other.c.size()); -- not avail for SvgNodeList
+    for(const auto& ptr : other.c) {
       c.push_back(ptr->clone());
       c.back()->setParent(newparent);
     }
   }
-  ~cloning_container() { for(auto& ptr : c) delete ptr; }
+  // advance before delete since SvgNodeList iteration reads the node
+  ~cloning_container() { for(auto it = c.begin(); it != c.end();) delete *it++; }
   T& get() { return c; }
   const T& get() const { return c; }
 };
 
+struct SvgLazyContent;  // see SvgParser::LazyGroups
+
 // consider shorter name ... SvgGroupNode?
 class SvgContainerNode : public SvgNode
 {
 public:
   SvgContainerNode() {}
-  SvgContainerNode(const SvgContainerNode& other) : SvgNode(other), m_children(this, other.m_children) {}
+  SvgContainerNode(const SvgContainerNode& other);
+  ~SvgContainerNode() override;
   SvgContainerNode* clone() const override = 0;  // this is needed to clone container nodes w/o casting result
   SvgContainerNode* asContainerNode() override { return this; }
   const SvgContainerNode* asContainerNode() const override { return this; }
@@ -284,14 +610,27 @@ public:
 
   void addChild(SvgNode* child, SvgNode* next = NULL);
   SvgNode* removeChild(SvgNode* child);
-  std::list<SvgNode*>& children() { return m_children.get(); }
-  const std::list<SvgNode*>& children() const { return m_children.get(); }
-  SvgNode* firstChild() const { return children().empty() ? NULL : children().front(); }
+  SvgNodeList& children() { if(isLazy()) parseLazyContent();  return m_children.get(); }
+  const SvgNodeList& children() const { if(isLazy()) parseLazyContent();  return m_children.get(); }
+  SvgNode* firstChild() const { return children().front(); }
   SvgNode* nodeAt(const Point& p, bool visual_only = true) const;
+  // content not yet parsed - container was created w/ SvgParser::LazyGroups and children() has not been called
+  bool isLazy() const { return m_lazyPending.load(std::memory_order_acquire); }
+  // children parsed so far; unlike children(), does not trigger parsing of lazy content
+  const SvgNodeList& parsedChildren() const { return m_children.get(); }
+  // bounds hint (in local coords) for lazy content; invalid if not lazy or no hint was provided
+  Rect lazyBounds() const;
 
 //protected:
-  cloning_container< std::list<SvgNode*> > m_children;
+  // lazy content is parsed while holding a global (recursive) lock, so document can be drawn from multiple threads;
+  //  once parsed, only m_lazyPending is checked
+  void parseLazyContent() const;
+  void setLazyContent(SvgLazyContent* lazy);
+
+  cloning_container<SvgNodeList> m_children;
   mutable Rect m_removedBounds;
+  mutable std::unique_ptr<SvgLazyContent> m_lazy;
+  mutable std::atomic<bool> m_lazyPending{false};
 };
 
 class SvgG : public SvgContainerNode
@@ -378,8 +717,10 @@ class SvgDocument : public SvgContainerNode
 public:
   SvgDocument(real x = 0, real y = 0,
       SvgLength w = SvgLength(100, SvgLength::PERCENT), SvgLength h = SvgLength(100, SvgLength::PERCENT));
+  ~SvgDocument() override;
   Type type() const override { return DOC; }
   SvgDocument* clone() const override;
+  SvgArena* arena() const { return m_arena; }
 
   SvgLength width() const { return m_useWidth > 0 ? SvgLength(m_useWidth) : m_width; }
   SvgLength height() const { return m_useHeight > 0 ? SvgLength(m_useHeight) : m_height; }
@@ -390,9 +731,9 @@ public:
   bool preserveAspectRatio() const { return m_preserveAspectRatio; }
 #ifndef NO_DYNAMIC_STYLE
   //~SvgDocument() override;
-  void setStylesheet(std::shared_ptr<SvgCssStylesheet> ss);
+  void setStylesheet(std::shared_ptr<const SvgCssStylesheet> ss);
   //void setStylesheet(SvgCssStylesheet* ss) { setStylesheet(std::shared_ptr<SvgCssStylesheet>(ss)); }
-  SvgCssStylesheet* stylesheet() { return m_stylesheet.get(); }
+  const SvgCssStylesheet* stylesheet() const { return m_stylesheet.get(); }
 #endif
 
   Rect viewBox() const { return m_viewBox; }
@@ -414,7 +755,10 @@ public:
   bool canRestyle();
   void replaceIds(SvgDocument* dest = NULL);
 
+  // bounds calculator for documents w/o boundsCalculator: sharedBoundsCalc if set (not thread-safe, since
+  //  SvgPainter is not reentrant), otherwise one created for each thread on first use
   static SvgPainter* sharedBoundsCalc;
+  static SvgPainter* defaultBoundsCalc();
 
 //private:
   real m_x = 0, m_y = 0;
@@ -427,8 +771,20 @@ public:
 
   std::unordered_multimap<std::string, SvgFont*> m_fonts;  // key is family name, can have >1 style per family
   std::unordered_map<std::string, SvgNode*> m_namedNodes;
+  // ids in content not yet parsed (SvgParser::LazyGroups); namedNode() parses content on demand
+  std::unordered_map<std::string, SvgContainerNode*> m_lazyIds;
+  // lazy content is parsed under mutex of root document; namedNode() only takes it while hasIds is set, i.e.,
+  //  until all lazy content w/ ids has been parsed
+  struct LazyState {
+    std::recursive_mutex mutex;
+    std::atomic<bool> hasIds{false};
+    LazyState() {}
+    LazyState(const LazyState& other) : hasIds(other.hasIds.load(std::memory_order_relaxed)) {}
+  };
+  mutable LazyState m_lazyState;
+  SvgArena* m_arena = NULL;  // owned; set for root document w/ SvgParser::ArenaAlloc
 #ifndef NO_DYNAMIC_STYLE
-  std::shared_ptr<SvgCssStylesheet> m_stylesheet;
+  std::shared_ptr<const SvgCssStylesheet> m_stylesheet;
 #endif
 };
 
@@ -436,17 +792,37 @@ class SvgImage : public SvgNode
 {
 public:
   SvgImage(Image image, const Rect& bounds, const char* linkStr = NULL);
+  // lazy image: encoded data (PNG, JPEG, etc.) is not decoded until image() is called
+  SvgImage(std::vector<unsigned char> encoded, const Rect& bounds, const char* linkStr = NULL);
   SvgImage(const SvgImage& other);
   Type type() const override { return IMAGE; }
   SvgImage* clone() const override { return new SvgImage(*this); }
-  Image* image() { return &m_image; }
+  Image* image() { if(m_encoded) decodeImage();  return &m_image; }
+  const Image* image() const { if(m_encoded) decodeImage();  return &m_image; }
+  bool isDecoded() const { return !m_encoded; }
   void setSize(const Rect& r) { m_bounds = r; invalidate(false); }
   Rect viewport() const;
 
+  // queue images for decoding on shared pool of background threads (joined at exit); image() blocks if called
+  //  while decode is in progress
+  static void decodeInBackground(const std::vector<SvgImage*>& images);
+
 //private:
-  Image m_image;
+  // shared w/ background decode threads so node can be deleted while decode is pending
+  struct EncodedImage {
+    std::mutex mutex;
+    std::vector<unsigned char> data;
+    Image image = Image(0, 0);
+    bool decoded = false;
+    EncodedImage(std::vector<unsigned char> d) : data(std::move(d)) {}
+    void decode();
+  };
+  void decodeImage() const;
+
+  mutable Image m_image;
+  mutable std::shared_ptr<EncodedImage> m_encoded;
   Rect m_bounds;
-  std::string m_linkStr;
+  std::string m_linkStr;  // empty for data URI (decoded bytes are held instead)
 
   Rect srcRect;
 };
@@ -456,15 +832,32 @@ class SvgPath : public SvgNode
 public:
   SvgPath(const Path2D& path, Type pathtype = PATH) : m_path(path), m_pathType(pathtype) {}
   SvgPath(Type pathtype = PATH) : m_pathType(pathtype) {}
+  // lazy path: path data string is not parsed until path() is called (under document's lazy content lock, so
+  //  lazy paths can be drawn from multiple threads)
+  explicit SvgPath(std::string pathdata)
+      : m_pathType(PATH), m_unparsed(!pathdata.empty()), m_pathData(std::move(pathdata)) {}
+  SvgPath(const SvgPath& other) : SvgNode(other), m_path(other.m_path), m_pathType(other.m_pathType),
+      m_unparsed(other.m_unparsed.load(std::memory_order_acquire)), m_pathData(other.m_pathData) {}
   Type type() const override { return PATH; }
   SvgPath* clone() const override { return new SvgPath(*this); }
 
-  Path2D* path() { return &m_path; }
+  Path2D* path() { if(m_unparsed.load(std::memory_order_acquire)) parseLazyPath();  return &m_path; }
+  const Path2D* path() const { if(m_unparsed.load(std::memory_order_acquire)) parseLazyPath();  return &m_path; }
   Type pathType() const { return m_pathType; }
+  // unparsed path data - empty unless created as lazy path and path() has not been called yet; not safe to
+  //  call while another thread may be calling path()
+  const std::string& pathData() const { return m_pathData; }
 
 //protected:
-  Path2D m_path;
+  void parsePathData() const { std::vector<real> points;  parsePathData(points); }
+  // caller must ensure no other thread is accessing path (e.g. ParallelPathData worker), otherwise use path()
+  void parsePathData(std::vector<real>& points) const;
+  void parseLazyPath() const;
+
+  mutable Path2D m_path;
   Type m_pathType;
+  mutable std::atomic<bool> m_unparsed{false};  // set while m_pathData holds unparsed path data
+  mutable std::string m_pathData;
 };
 
 class SvgRect : public SvgPath
@@ -492,10 +885,15 @@ class SvgUse : public SvgNode
 {
 public:
   SvgUse(const Rect& bounds, const char* linkStr, const SvgNode* link, SvgDocument* doc = NULL);
+  // external document doc may be shared w/ other SvgUse nodes
+  SvgUse(const Rect& bounds, const char* linkStr, const SvgNode* link, std::shared_ptr<SvgDocument> doc);
   Type type() const override { return USE; }
   SvgUse* clone() const override { return new SvgUse(*this); }
   void setTarget(const SvgNode* link, std::shared_ptr<SvgDocument> doc = {});
+  // attach external document loaded after node was created; target is doc itself or node w/ id in doc
+  void setExternalDoc(std::shared_ptr<SvgDocument> doc, const char* id = NULL);
   const SvgNode* target() const;
+  const std::shared_ptr<SvgDocument>& externalDoc() const { return m_doc; }
   const char* href() const { return m_linkStr.c_str(); }
   void setHref(const char* s) { m_linkStr = s;  m_link = NULL;  invalidate(false); }
   // probably should have separate fns for x,y,width,height
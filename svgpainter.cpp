@@ -116,7 +116,7 @@ void SvgPainter::clearDirty(const SvgNode* node)
     const SvgContainerNode* container = node->asContainerNode();
     if(container) {
       container->m_removedBounds = Rect();
-      for(SvgNode* child : container->children())
+      for(SvgNode* child : container->parsedChildren())
         clearDirty(child);
     }
   }
@@ -130,7 +130,7 @@ static void clearRenderedBounds(const SvgNode* node)
   // don't descend into <pattern>; technically, we also don't have to descend into a subtree w/ no named nodes
   //  since nothing inside can be referenced, but not worth the hassle of trying to detect this case
   if(container && container->type() != SvgNode::PATTERN) {
-    for(const SvgNode* child : container->children())
+    for(const SvgNode* child : container->parsedChildren())
       clearRenderedBounds(child);
   }
 }
@@ -229,7 +229,13 @@ Rect SvgPainter::bounds(const SvgNode* node, bool parentstyle)
     case SvgNode::PATH:   b = _bounds(static_cast<const SvgPath*>(node));  break;
     // <symbol> is excluded by isVisible() check in childrenBounds; this is only hit from _bounds(SvgUse*)
     case SvgNode::SYMBOL: //[[fallthrough]]   // childrenBounds called directly just for shorter stack traces
-    case SvgNode::G:      b = childrenBounds(static_cast<const SvgContainerNode*>(node));  break;
+    case SvgNode::G:
+    {
+      // use bounds hint, if any, for unparsed lazy group so it can be culled w/o parsing
+      Rect hint = static_cast<const SvgContainerNode*>(node)->lazyBounds();
+      b = hint.isValid() ? p->getTransform().mapRect(hint) : childrenBounds(static_cast<const SvgContainerNode*>(node));
+      break;
+    }
     case SvgNode::IMAGE:  b = _bounds(static_cast<const SvgImage*>(node));  break;
     case SvgNode::USE:    b = _bounds(static_cast<const SvgUse*>(node));  break;
     case SvgNode::TEXT:   b = _bounds(static_cast<const SvgText*>(node));   break;
@@ -493,12 +499,12 @@ void SvgPainter::_draw(const SvgDocument* doc)
 
 void SvgPainter::_draw(const SvgImage* node)
 {
-  p->drawImage(node->viewport(), node->m_image, node->srcRect);
+  p->drawImage(node->viewport(), *node->image(), node->srcRect);
 }
 
 void SvgPainter::_draw(const SvgPath* node)
 {
-  const Path2D& m_path = node->m_path;
+  const Path2D& m_path = *node->path();
   if(m_path.empty())
     return;
   ExtraState& state = extraState();
@@ -636,11 +642,11 @@ Rect SvgPainter::_bounds(const SvgPath* node)
   // no path is set for rect with zero width or height (to suppress drawing) but we still want bounds
   if(node->pathType() == SvgNode::RECT)
     return p->getTransform().mapRect(Rect(static_cast<const SvgRect*>(node)->m_rect).pad(strokewidth/2));
-  if(node->m_path.empty())
+  const Path2D& path = *node->path();
+  if(path.empty())
     return Rect();
   // I think we can just map the bounding rect if there is no rotation ... probably should add some tests!
-  Rect b = !tf.isRotating() ? tf.mapRect(node->m_path.boundingRect())
-      : Path2D(node->m_path).transform(tf).boundingRect();
+  Rect b = !tf.isRotating() ? tf.mapRect(path.boundingRect()) : Path2D(path).transform(tf).boundingRect();
   //return b.pad(tf.xscale() * strokewidth/2, tf.yscale() * strokewidth/2);
   return b.pad(strokewidth/2);
 }
@@ -911,7 +917,7 @@ static void trimU32String(std::u32string& s)
 std::string SvgPainter::breakText(const SvgText* node, real maxWidth)
 {
   SvgDocument* root = node->rootDocument();
-  SvgPainter* bounder = root && root->boundsCalculator ? root->boundsCalculator : SvgDocument::sharedBoundsCalc;
+  SvgPainter* bounder = root && root->boundsCalculator ? root->boundsCalculator : SvgDocument::defaultBoundsCalc();
   auto glyphpos = bounder->glyphPositions(node);
   std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t> cv;
   std::string s8 = node->text();
@@ -948,7 +954,7 @@ std::string SvgPainter::breakText(const SvgText* node, real maxWidth)
 void SvgPainter::elideText(SvgText* textnode, real maxWidth)
 {
   SvgDocument* root = textnode->rootDocument();
-  SvgPainter* bounder = root && root->boundsCalculator ? root->boundsCalculator : SvgDocument::sharedBoundsCalc;
+  SvgPainter* bounder = root && root->boundsCalculator ? root->boundsCalculator : SvgDocument::defaultBoundsCalc();
   std::string s = textnode->text();
   if(strchr(s.c_str(), '\n')) {
     std::replace(s.begin(), s.end(), '\n', ' ');
@@ -1,15 +1,15 @@
 #include <fstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <future>
+#include <unordered_set>
+#include <sys/stat.h>
 #include "svgparser.h"
 
 
-struct SvgNamedColor {
-  const char* name;
-  color_t color;
-  friend bool operator<(const SvgNamedColor& a, const SvgNamedColor& b) { return strcmp(a.name, b.name) < 0; }
-};
-
 // added non-standard colors: grey (== gray)
-SvgNamedColor svgNamedColors[] = {
+static constexpr SvgEnumVal svgNamedColors[] = {
   {"aliceblue", 0xF0F8FF}, {"antiquewhite", 0xFAEBD7}, {"aqua", 0x00FFFF}, {"aquamarine", 0x7FFFD4},
   {"azure", 0xF0FFFF}, {"beige", 0xF5F5DC}, {"bisque", 0xFFE4C4}, {"black", 0x000000},
   {"blanchedalmond", 0xFFEBCD}, {"blue", 0x0000FF}, {"blueviolet", 0x8A2BE2}, {"brown", 0xA52A2A},
@@ -48,16 +48,67 @@ SvgNamedColor svgNamedColors[] = {
   {"violet", 0xEE82EE}, {"wheat", 0xF5DEB3}, {"white", 0xFFFFFF}, {"whitesmoke", 0xF5F5F5},
   {"yellow", 0xFFFF00}, {"yellowgreen", 0x9ACD32}
 };
-#ifndef NDEBUG
-// no luck trying to do this with static_assert
-static struct svgNamedColors_CHECK_t { svgNamedColors_CHECK_t() {
-    ASSERT(std::is_sorted(std::begin(svgNamedColors), std::end(svgNamedColors))); }} svgNamedColors_CHECK;
-#endif
+static constexpr auto svgNamedColorMap = makeKeywordMap(svgNamedColors);
 
 // realToStr and strToReal take the most cycles, so could try github.com/miloyip/itoa-benchmark/
 // There's also github.com/miloyip/dtoa-benchmark/ for float to str, but I don't think any of these
 //  would beat our int approach if fully optimized
 
+// Fast path for the common case of plain decimal numbers w/ a short mantissa and a small exponent: mantissa
+//  and power of 10 are both exact in real (up to 2^53 and 1e22 for double, 2^24 and 1e10 for float), so a
+//  single multiply or divide in real gives the correctly rounded result (Clinger's fast path) - computing in
+//  double and narrowing to float could round twice.  Anything else (long mantissas, hex, inf, etc.) falls back
+//  to strToReal.  Same contract as strToReal: endptr is set to char after number.  testNumberParsing() in
+//  usvgtest checks results (incl. values near halfway between floats) against strtod/strtof
+static real fastStrToReal(const char* s, char** endptr)
+{
+  static constexpr bool isDouble = sizeof(real) == sizeof(double);
+  static constexpr uint64_t MAX_EXACT_MANT = uint64_t(1) << (isDouble ? 53 : 24);
+  static constexpr int MAX_EXACT_EXP10 = isDouble ? 22 : 10;
+  static const real pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+  const char* p = s;
+  bool neg = *p == '-';
+  if(*p == '-' || *p == '+') ++p;
+  uint64_t mant = 0;
+  int ndigits = 0, exp10 = 0;
+  bool any = false;
+  for(; isDigit(*p); ++p) {
+    any = true;
+    if(mant || *p != '0') { mant = mant*10 + (*p - '0'); ++ndigits; }
+  }
+  if(*p == '.') {
+    for(++p; isDigit(*p); ++p) {
+      any = true;
+      if(mant || *p != '0') { mant = mant*10 + (*p - '0'); ++ndigits; }
+      --exp10;
+    }
+  }
+  if(!any || ndigits > 15 || mant > MAX_EXACT_MANT || *p == 'x' || *p == 'X')
+    return strToReal(s, endptr);
+  if(*p == 'e' || *p == 'E') {
+    // exponent is only consumed if at least one digit follows
+    const char* q = p + 1;
+    bool negexp = *q == '-';
+    if(*q == '-' || *q == '+') ++q;
+    if(isDigit(*q)) {
+      int e = 0;
+      for(; isDigit(*q); ++q)
+        e = std::min(e*10 + (*q - '0'), 10000);
+      exp10 += negexp ? -e : e;
+      p = q;
+    }
+  }
+  real val = real(mant);
+  if(mant && exp10 != 0) {
+    if(exp10 < -MAX_EXACT_EXP10 || exp10 > MAX_EXACT_EXP10)
+      return strToReal(s, endptr);
+    val = exp10 < 0 ? val/pow10[-exp10] : val*pow10[exp10];
+  }
+  *endptr = (char*)p;
+  return real(neg ? -val : val);
+}
+
 real toReal(const StringRef& str, real dflt, int* advance)
 {
   const char* s0 = str.data();
@@ -74,19 +125,25 @@ real toReal(const StringRef& str, real dflt, int* advance)
   char* endptr;
   char c = *e;
   if(c && (isDigit(c) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E')) {
-#ifndef NDEBUG
-    PLATFORM_LOG("Creating temporary string in toReal\n");
-#endif
     // have to use a copy if strToReal could advance beyond end of StringRef
-    std::string temp(s, e - s);
-    const char* t = temp.c_str();
-    real res = strToReal(t, &endptr);
+    char buff[64];
+    std::string temp;
+    const char* t = buff;
+    if(size_t(e - s) < sizeof(buff)) {
+      memcpy(buff, s, e - s);
+      buff[e - s] = '\0';
+    }
+    else {
+      temp.assign(s, e - s);
+      t = temp.c_str();
+    }
+    real res = fastStrToReal(t, &endptr);
     if(advance)
       *advance = (endptr - t) + (s - s0);
     return res;
   }
 
-  real res = strToReal(s, &endptr);
+  real res = fastStrToReal(s, &endptr);
   if(advance)
     *advance = endptr - s0;
   return res;
@@ -106,7 +163,7 @@ std::vector<real>& parseNumbersList(StringRef& str, std::vector<real>& points)
     //points.push_back(toDouble(str, NULL, &advance));
     //str += advance;
     const char* s = str.data();
-    points.push_back(strToReal(s, &endptr));
+    points.push_back(fastStrToReal(s, &endptr));
     str += endptr - s;
     str.trimL();
     if(*str == ',') {
@@ -131,10 +188,31 @@ std::vector<real>& SvgParser::parseNumbersList(StringRef& str)
   return ::parseNumbersList(str, numberList);
 }
 
+// like parseNumbersList but w/ fixed size array; returns number of values parsed, which may exceed maxargs
+static size_t parseTransformArgs(StringRef& str, real* args, size_t maxargs)
+{
+  size_t nargs = 0;
+  char* endptr;
+  str.trimL();
+  while(!str.isEmpty() && (isDigit(*str) || *str == '-' || *str == '+' || *str == '.')) {
+    const char* s = str.data();
+    real val = fastStrToReal(s, &endptr);
+    if(nargs < maxargs)
+      args[nargs] = val;
+    ++nargs;
+    str += endptr - s;
+    str.trimL();
+    if(*str == ',') {
+      ++str;
+      str.trimL();
+    }
+  }
+  return nargs;
+}
+
 static Transform2D parseTransformMatrix(StringRef str)
 {
-  std::vector<real> args;
-  args.reserve(6);
+  real args[6];
   Transform2D matrix;
   while(!str.isEmpty()) {
     if(isSpace(*str) || *str == ',') { ++str; continue; }
@@ -143,21 +221,21 @@ static Transform2D parseTransformMatrix(StringRef str)
     str.trimL();
     if(str.isEmpty() || *str != '(') break;
     ++str;
-    parseNumbersList(str, args);  // this will consume trailing spaces
+    size_t nargs = parseTransformArgs(str, args, 6);  // this will consume trailing spaces
     if(str.isEmpty() || *str != ')') break;
     ++str;
-    if(cmd == "matrix" && args.size() == 6)
+    if(cmd == "matrix" && nargs == 6)
       matrix = matrix * Transform2D(args[0], args[1], args[2], args[3], args[4], args[5]);
-    else if(cmd == "translate" && (args.size() == 1 || args.size() == 2))
-      matrix = matrix * Transform2D::translating(args[0], args.size() == 2 ? args[1] : 0);
-    else if(cmd == "rotate" && (args.size() == 1 || args.size() == 3))
+    else if(cmd == "translate" && (nargs == 1 || nargs == 2))
+      matrix = matrix * Transform2D::translating(args[0], nargs == 2 ? args[1] : 0);
+    else if(cmd == "rotate" && (nargs == 1 || nargs == 3))
       matrix = matrix * Transform2D::rotating(args[0]*M_PI/180,
-          args.size() == 3 ? Point(args[1], args[2]) : Point(0,0));
-    else if(cmd == "scale" && (args.size() == 1 || args.size() == 2))
-      matrix = matrix * Transform2D::scaling(args[0], args.size() == 2 ? args[1] : args[0]);
-    else if(cmd == "skewX" && args.size() == 1)
+          nargs == 3 ? Point(args[1], args[2]) : Point(0,0));
+    else if(cmd == "scale" && (nargs == 1 || nargs == 2))
+      matrix = matrix * Transform2D::scaling(args[0], nargs == 2 ? args[1] : args[0]);
+    else if(cmd == "skewX" && nargs == 1)
       matrix = matrix * Transform2D().shear(std::tan(args[0]*M_PI/180), 0);
-    else if(cmd == "skewY" && args.size() == 1)
+    else if(cmd == "skewY" && nargs == 1)
       matrix = matrix * Transform2D().shear(0, std::tan(args[0]*M_PI/180));
     else
       break;
@@ -187,9 +265,8 @@ Color parseColor(StringRef str, const Color& dflt)
     int r = (num >> 8) & 0x0F, g = (num >> 4) & 0x0F, b = num & 0x0F;
     return Color(r*16 + r, g*16 + g, b*16 + b);
   }
-  std::string colorLower = toLower(str.toString());
-  str = StringRef(colorLower);
-  if(str.startsWith("rgb(") || str.startsWith("rgba(")) {
+  // CSS color keywords and functions are case-insensitive
+  if(str.size() > 4 && (strncasecmp(str.data(), "rgb(", 4) == 0 || strncasecmp(str.data(), "rgba(", 5) == 0)) {
     StringRef compoStr(str + 4);
     int advance;
     if(*compoStr == '(') ++compoStr;
@@ -207,16 +284,12 @@ Color parseColor(StringRef str, const Color& dflt)
     return std::isnan(b) ? dflt : Color(int(r), int(g), int(b), int(a*255));
   }
 
-  if(colorLower == "none")
+  if(str.size() == 4 && strncasecmp(str.data(), "none", 4) == 0)
     return Color::NONE;
-  if(colorLower == "inherit")
+  if(str.size() == 7 && strncasecmp(str.data(), "inherit", 7) == 0)
     return dflt;
-  // try named color - assumes svgNamedColors is sorted!
-  SvgNamedColor colorNamed = { colorLower.c_str(), 0 };
-  auto it = std::lower_bound(std::begin(svgNamedColors), std::end(svgNamedColors), colorNamed);
-  if(it != std::end(svgNamedColors) && it->name == colorLower)
-    return Color::fromRgb(it->color);
-  return dflt;
+  int named = svgNamedColorMap.findNoCase(str, -1);
+  return named >= 0 ? Color::fromRgb(color_t(named)) : dflt;
 }
 
 SvgLength parseLength(const StringRef& str, const SvgLength& dflt)
@@ -348,7 +421,7 @@ static void pathArc(Path2D& path, real rx, real ry,
 }
 
 // we take vector to use so we don't need to alloc and free for every path
-static bool parsePathData(const StringRef& dataStr, Path2D& path, std::vector<real>& points)
+bool parsePathData(const StringRef& dataStr, Path2D& path, std::vector<real>& points)
 {
   real x0 = 0, y0 = 0;  // initial point
   real x = 0, y = 0;  // current point
@@ -562,12 +635,16 @@ SvgNode* SvgParser::createDefsNode()
   return new SvgDefs();
 }
 
+// limit on threads reading <image> files and on threads loading external documents w/ AsyncResources
+static constexpr size_t MAX_PENDING_LOADS = 32;
+
 SvgNode* SvgParser::createImageNode()
 {
   const char* target = useHref();
   StringRef targetref = StringRef(target).trimmed();
   if(targetref.size() > 4 && strncasecmp(targetref.end() - 4, ".svg", 4) == 0) {
     nodeAttributes.emplace_back("xlink:href", target);
+    indexAttributes();
     return createUseNode();
   }
 
@@ -576,28 +653,80 @@ SvgNode* SvgParser::createImageNode()
   real w = lengthToPx(useAttribute("width"), 0);
   real h = lengthToPx(useAttribute("height"), 0);
 
+  bool lazy = m_flags & (LazyImages | BackgroundImageDecode);
   Image image(0,0);
+  std::vector<unsigned char> encoded;
   if(targetref.startsWith("data")) {
     while(!targetref.isEmpty() && !targetref.startsWith("base64,"))
       ++targetref;
     if(!targetref.isEmpty()) {
-      auto dec64 = base64_decode(targetref.constData()+7, targetref.size()-7);
-      image = Image::decodeBuffer(dec64.data(), dec64.size());
-      if(image.width > 0 && image.height > 0)
+      // lazy image keeps decoded bytes, otherwise reuse buffer across images
+      std::vector<unsigned char>& buff = lazy ? encoded : m_imageBuff;
+      buff.resize(base64MaxDecLen(targetref.size()-7));
+      buff.resize(base64Decode(targetref.constData()+7, targetref.size()-7, buff.data()));
+      if(!reserveImagePixels(buff.data(), buff.size())) {
+        limitExceeded("image pixels", m_limits.maxImagePixels);
+        return NULL;
+      }
+      // lazy image holds decoded bytes, so URI isn't needed (bytes are written back if image can't be decoded)
+      if(lazy)
         target = NULL;
+      else {
+        image = Image::decodeBuffer(buff.data(), buff.size());
+        if(image.width > 0 && image.height > 0)
+          target = NULL;
+      }
     }
     else
       PLATFORM_LOG("Unrecognized inline image format!\n");
   }
+  else if(!targetref.isEmpty() && (m_flags & AsyncResources)) {
+    // file is read (and decoded unless lazy) on another thread; node is filled in before parse returns
+    SvgImage* node = new SvgImage(std::move(image), Rect::ltwh(x, y, w, h), target);
+    std::string path = toAbsPath(targetref);
+    if(m_pendingLoads.size() - m_loadsWaited >= MAX_PENDING_LOADS)
+      m_pendingLoads[m_loadsWaited++].image.wait();
+    // loader must not touch node, which is part of document being parsed
+    m_pendingLoads.push_back({node, std::async(std::launch::async, [this, path, lazy](){
+      LoadedImage res;
+      if(!readFile(&res.encoded, path.c_str())) {
+#ifndef NDEBUG
+        PLATFORM_LOG("Error opening SVG <image> href: %s\n", path.c_str());
+#endif
+        return res;
+      }
+      if(!reserveImagePixels(res.encoded.data(), res.encoded.size()))
+        res.encoded.clear();  // error is set by waitPendingLoads()
+      else if(!lazy) {
+        res.image = Image::decodeBuffer(res.encoded.data(), res.encoded.size());
+        res.encoded.clear();
+      }
+      return res;
+    })});
+    if(m_flags & BackgroundImageDecode)
+      m_pendingImages.push_back(node);
+    return node;
+  }
   else if(!targetref.isEmpty()) {
-    std::vector<unsigned char> buff;
-    if(readFile(&buff, toAbsPath(targetref).c_str()))
-      image = Image::decodeBuffer(buff.data(), buff.size());
+    if(readFile(&encoded, toAbsPath(targetref).c_str())) {
+      if(!reserveImagePixels(encoded.data(), encoded.size())) {
+        limitExceeded("image pixels", m_limits.maxImagePixels);
+        return NULL;
+      }
+      if(!lazy)
+        image = Image::decodeBuffer(encoded.data(), encoded.size());
+    }
 #ifndef NDEBUG
     else
       PLATFORM_LOG("Error opening SVG <image> href: %s\n", toAbsPath(targetref).c_str());
 #endif
   }
+  if(lazy && !encoded.empty()) {
+    SvgImage* node = new SvgImage(std::move(encoded), Rect::ltwh(x, y, w, h), target);
+    if(m_flags & BackgroundImageDecode)
+      m_pendingImages.push_back(node);
+    return node;
+  }
   return new SvgImage(std::move(image), Rect::ltwh(x, y, w, h), target);
 }
 
@@ -694,8 +823,20 @@ SvgNode* SvgParser::createPatternNode()
 SvgNode* SvgParser::createPathNode()
 {
   StringRef data = useAttribute("d");
+  // maxPathPoints can't be enforced for lazy path data, so it is parsed (in parallel) before parse returns
+  bool lazy = (m_flags & LazyPathData) && !m_limits.maxPathPoints;
+  if(m_flags & (LazyPathData | ParallelPathData)) {
+    SvgPath* path = new SvgPath(std::string(data.data(), data.size()));
+    if(!lazy && !data.isEmpty())
+      m_pendingPaths.push_back(path);
+    return path;
+  }
   SvgPath* path = new SvgPath();
   parsePathData(data, path->m_path, this->numberList);
+  if(m_limits.maxPathPoints && !addPathPoints(path->m_path.points.size())) {
+    delete path;
+    return NULL;
+  }
   return path;
 }
 
@@ -703,6 +844,8 @@ SvgNode* SvgParser::createPolygonNode()
 {
   StringRef spoints = useAttribute("points");
   std::vector<real>& points = parseNumbersList(spoints);
+  if(m_limits.maxPathPoints && !addPathPoints(points.size()/2))
+    return NULL;
   SvgPath* path = new SvgPath(SvgNode::POLYGON);
   path->m_path.reserve(points.size()/2 + 1);
   for(size_t ii = 0; ii+1 < points.size(); ii += 2)
@@ -715,6 +858,8 @@ SvgNode* SvgParser::createPolylineNode()
 {
   StringRef spoints = useAttribute("points");
   std::vector<real>& points = parseNumbersList(spoints);
+  if(m_limits.maxPathPoints && !addPathPoints(points.size()/2))
+    return NULL;
   SvgPath* path = new SvgPath(SvgNode::POLYLINE);
   path->m_path.reserve(points.size()/2);
   for(size_t ii = 0; ii+1 < points.size(); ii += 2)
@@ -804,79 +949,84 @@ SvgNode* SvgParser::createUseNode()
   // if link does not start with '#', assume string before '#' (if present) is filename, in which case
   //  document is loaded now
   SvgNode* link = NULL;
-  SvgDocument* doc = NULL;
+  std::shared_ptr<SvgDocument> doc;
   if(href.size() > 1 && href[0] != '#') {
-    // safest way to prevent recursive include would be to enforce a max depth
+    // Limits::maxExternalDepth prevents unbounded recursive includes
+    if(m_limits.maxExternalDepth && m_extDepth >= m_limits.maxExternalDepth) {
+      limitExceeded("external reference depth", m_limits.maxExternalDepth);
+      return NULL;
+    }
     std::vector<StringRef> fileAndId = splitStringRef(href, '#');
-    doc = SvgParser().parseFile(toAbsPath(fileAndId[0]).c_str());
+    if(m_flags & AsyncResources) {
+      // document is loaded on another thread and attached to node before parse returns
+      SvgUse* node = new SvgUse(Rect::ltwh(x, y, w, h), href.toString().c_str(), NULL);
+      std::string id = fileAndId.size() == 2 ? fileAndId[1].toString() : std::string();
+      std::string path = toAbsPath(fileAndId[0]);
+      unsigned int flags = m_flags;
+      OpenStreamFn openfn = m_openStream;
+      uint64_t streamid = m_openStreamId;
+      Limits limits = m_limits;
+      size_t depth = m_extDepth + 1;
+      if(m_pendingUses.size() - m_usesWaited >= MAX_PENDING_LOADS)
+        m_pendingUses[m_usesWaited++].doc.wait();
+      m_pendingUses.push_back({node, std::move(id), std::async(std::launch::async, [=](){
+        return loadExternalDoc(path.c_str(), flags, openfn, streamid, limits, depth);
+      })});
+      return node;
+    }
+    ExternalDoc ext = loadExternalDoc(toAbsPath(fileAndId[0]).c_str(), m_flags, m_openStream, m_openStreamId,
+        m_limits, m_extDepth + 1);
+    if(!ext.error.empty()) {
+      m_error = ext.error;
+      return NULL;
+    }
+    doc = std::move(ext.doc);
     if(doc) {
       if(fileAndId.size() == 2 && !fileAndId[1].isEmpty())
         href = fileAndId[1];  //link = doc->namedNode(fileAndId[1].toString().c_str() + 1);
       else
-        link = doc;
+        link = doc.get();
     }
   }
-  // SvgUse takes ownership of doc
-  return new SvgUse(Rect::ltwh(x, y, w, h), href.toString().c_str(), link, doc);
+  return new SvgUse(Rect::ltwh(x, y, w, h), href.toString().c_str(), link, std::move(doc));
 }
 
 SvgNode* SvgParser::createNode(StringRef name)
 {
-  if(name.isEmpty())
-    return NULL;
-
-  StringRef ref(name + 1);
-  switch(name[0]) {
-  case 'a':
-    if(ref.isEmpty()) return createANode();
-    break;
-  case 'c':
-    if(ref == "ircle") return createCircleNode();
-    break;
-  case 'd':
-    if(ref == "efs") return createDefsNode();
-    break;
-  case 'e':
-    if(ref == "llipse") return createEllipseNode();
-    break;
-  case 'f':
-    if(ref == "ont") return createFontNode();
-    break;
-  case 'g':
-    if(ref.isEmpty()) return createGNode();
-    break;
-  case 'i':
-    if(ref == "mage") return createImageNode();
-    break;
-  case 'l':
-    if(ref == "ine") return createLineNode();
-    if(ref == "inearGradient") return createLinearGradientNode();
-    break;
-  case 'p':
-    if(ref == "ath") return createPathNode();
-    if(ref == "attern") return createPatternNode();
-    if(ref == "olygon") return createPolygonNode();
-    if(ref == "olyline") return createPolylineNode();
-    break;
-  case 'r':
-    if(ref == "ect") return createRectNode();
-    if(ref == "adialGradient") return createRadialGradientNode();
-    break;
-  case 's':
-    if(ref == "vg") return createSvgDocumentNode();
-    if(ref == "ymbol") return createSymbolNode();
-    break;
-  case 't':
-    if(ref == "ext") return createTextNode();
-    if(ref == "span") return createTspanNode();  // shouldn't be here since <tspan> can only be inside <text>
-    break;
-  case 'u':
-    if(ref == "se") return createUseNode();
-    break;
-  default:
-    break;
+  enum { A_NODE, CIRCLE_NODE, DEFS_NODE, ELLIPSE_NODE, FONT_NODE, G_NODE, IMAGE_NODE, LINE_NODE, LINEARGRAD_NODE,
+    PATH_NODE, PATTERN_NODE, POLYGON_NODE, POLYLINE_NODE, RECT_NODE, RADIALGRAD_NODE, SVG_NODE, SYMBOL_NODE,
+    TEXT_NODE, TSPAN_NODE, USE_NODE };
+  static constexpr SvgEnumVal nodeNames[] = { {"a", A_NODE}, {"circle", CIRCLE_NODE}, {"defs", DEFS_NODE},
+    {"ellipse", ELLIPSE_NODE}, {"font", FONT_NODE}, {"g", G_NODE}, {"image", IMAGE_NODE}, {"line", LINE_NODE},
+    {"linearGradient", LINEARGRAD_NODE}, {"path", PATH_NODE}, {"pattern", PATTERN_NODE},
+    {"polygon", POLYGON_NODE}, {"polyline", POLYLINE_NODE}, {"rect", RECT_NODE},
+    {"radialGradient", RADIALGRAD_NODE}, {"svg", SVG_NODE}, {"symbol", SYMBOL_NODE}, {"text", TEXT_NODE},
+    {"tspan", TSPAN_NODE}, {"use", USE_NODE} };
+  static constexpr auto nodeNameMap = makeKeywordMap(nodeNames);
+
+  switch(nodeNameMap.find(name, -1)) {
+  case A_NODE: return createANode();
+  case CIRCLE_NODE: return createCircleNode();
+  case DEFS_NODE: return createDefsNode();
+  case ELLIPSE_NODE: return createEllipseNode();
+  case FONT_NODE: return createFontNode();
+  case G_NODE: return createGNode();
+  case IMAGE_NODE: return createImageNode();
+  case LINE_NODE: return createLineNode();
+  case LINEARGRAD_NODE: return createLinearGradientNode();
+  case PATH_NODE: return createPathNode();
+  case PATTERN_NODE: return createPatternNode();
+  case POLYGON_NODE: return createPolygonNode();
+  case POLYLINE_NODE: return createPolylineNode();
+  case RECT_NODE: return createRectNode();
+  case RADIALGRAD_NODE: return createRadialGradientNode();
+  case SVG_NODE: return createSvgDocumentNode();
+  case SYMBOL_NODE: return createSymbolNode();
+  case TEXT_NODE: return createTextNode();
+  case TSPAN_NODE: return createTspanNode();  // shouldn't be here since <tspan> can only be inside <text>
+  case USE_NODE: return createUseNode();
+  default: return NULL;
   }
-  return NULL;
 }
 
 bool SvgParser::parseCoreNode(SvgNode* node)
@@ -894,8 +1044,43 @@ bool SvgParser::parseCoreNode(SvgNode* node)
   return true;
 }
 
+// a linear search is faster for the typical element w/ only a few attributes
+static constexpr size_t MIN_INDEXED_ATTRS = 8;
+
+// must be called after changing nodeAttributes
+void SvgParser::indexAttributes()
+{
+  attrIndex.clear();
+  if(nodeAttributes.size() < MIN_INDEXED_ATTRS)
+    return;
+  size_t mask = 15;
+  while(mask < 2*nodeAttributes.size()) mask = 2*mask + 1;
+  attrIndex.resize(mask + 1, {0, -1});
+  for(size_t ii = 0; ii < nodeAttributes.size(); ++ii) {
+    if(!nodeAttributes[ii].name) continue;
+    unsigned int h = svgHash(nodeAttributes[ii].name);
+    size_t slot = h & mask;
+    while(attrIndex[slot].second >= 0) slot = (slot + 1) & mask;
+    attrIndex[slot] = {h, int(ii)};
+  }
+}
+
 const char* SvgParser::useAttribute(const char* name)
 {
+  if(!attrIndex.empty()) {
+    unsigned int h = svgHash(name);
+    size_t mask = attrIndex.size() - 1;
+    // linear probing preserves document order for duplicate names, same as linear search
+    for(size_t slot = h & mask; attrIndex[slot].second >= 0; slot = (slot + 1) & mask) {
+      NodeAttribute& a = nodeAttributes[attrIndex[slot].second];
+      if(attrIndex[slot].first == h && a.name && strcmp(name, a.name) == 0) {
+        a.name = NULL;
+        numUsedAttributes++;
+        return a.value;
+      }
+    }
+    return "";
+  }
   // previously, we were moving the last attribute into the slot for the used attribute, but it is
   //  ridiculous to be reordering attributes due to an silly implementation detail
   for(auto& a : nodeAttributes) {
@@ -928,8 +1113,11 @@ bool SvgParser::startElement(StringRef nodeName, const XmlStreamAttributes& attr
   numUsedAttributes = 0;
   for(XmlStreamAttribute xmlattr = attributes.firstAttribute(); xmlattr; xmlattr = xmlattr.next())
     nodeAttributes.emplace_back(xmlattr.name(), xmlattr.value());
+  indexAttributes();
 
   m_states.emplace_back(m_states.back());
+  if(m_hasLimits && !checkElementLimits())
+    return false;
   // this is pretty hacky ... core issue is that lengths should be stored as lengths and resolved when drawn
   real fontsize = lengthToPx(attributes.value("font-size"), 0);  // do not consume attribute
   if(fontsize > 0)
@@ -949,6 +1137,9 @@ bool SvgParser::startElement(StringRef nodeName, const XmlStreamAttributes& attr
       return false;
     m_doc = createSvgDocumentNode();
     node = m_doc;
+    // restored by SvgArena::Scope of caller - parseTokens() or parseXmlFragment()
+    if(m_flags & ArenaAlloc)
+      SvgArena::current = m_doc->m_arena = new SvgArena;
   }
   else if(parent->type() == SvgNode::TEXT || parent->type() == SvgNode::TSPAN || parent->type() == SvgNode::TEXTPATH) {
     SvgTspan* textnode = static_cast<SvgTspan*>(parent);
@@ -995,7 +1186,8 @@ bool SvgParser::startElement(StringRef nodeName, const XmlStreamAttributes& attr
 
   parseCoreNode(node);
   const char* stylestr = useAttribute("style");
-  node->attrs.reserve(nodeAttributes.size() - numUsedAttributes);
+  if(nodeAttributes.size() > numUsedAttributes)
+    node->attrs.mut().reserve(nodeAttributes.size() - numUsedAttributes);
   for(auto& a : nodeAttributes)
     processAttribute(node, SvgAttr::XMLSrc, a.name, a.value);  // processAttrbute checks !name
   // style string has higher precedence than CSS, but this is handled by SvgNode::setAttr()
@@ -1022,7 +1214,7 @@ bool SvgParser::cdata(const char* str)
 {
 #ifndef NO_CSS
   if(m_inStyle) {
-    m_stylesheet->parse_stylesheet(str);
+    m_styleText.append(str).append("\n");
     return true;
   }
 #endif
@@ -1036,24 +1228,199 @@ bool SvgParser::cdata(const char* str)
 
 void SvgParser::parse(XmlStreamReader* const xml)
 {
+  parseTokens(xml);
+  finishParse(xml);
+}
+
+// store unrecognized element as fragment (or skip it w/ DiscardUnknownNodes); returns false if more data is
+//  needed (XmlStreamReader::PushParse)
+bool SvgParser::readUnknownNode(XmlStreamReader* const xml)
+{
+  if(m_flags & DiscardUnknownNodes)
+    return xml->skipNode();
+  XmlFragment* frag = xml->readNodeAsFragment();
+  if(!frag)
+    return false;
+  if(m_nodes.back()->asContainerNode())
+    m_nodes.back()->asContainerNode()->addChild(new SvgXmlFragment(frag));
+  else
+    delete frag;  // read node to skip even if we can't add it to doc
+  return true;
+}
+
+// smaller groups are parsed immediately w/ LazyGroups since storing source would save little
+static constexpr size_t MIN_LAZY_GROUP_BYTES = 4096;
+
+static bool containsStr(const char* begin, const char* end, const char* s)
+{
+  return std::search(begin, end, s, s + strlen(s)) != end;
+}
+
+// find id (and xml:id, etc.) attribute values w/o parsing; false positives (e.g. from text content) just cause
+//  unnecessary parsing of lazy content
+static std::vector<std::string> scanIds(const char* src, const char* end)
+{
+  std::vector<std::string> ids;
+  for(const char* p = src; (p = std::search(p, end, "id", "id" + 2)) != end; p += 2) {
+    if(p > src && !isspace((unsigned char)p[-1]) && p[-1] != ':')
+      continue;
+    const char* q = p + 2;
+    while(q != end && isspace((unsigned char)*q)) ++q;
+    if(q == end || *q++ != '=')
+      continue;
+    while(q != end && isspace((unsigned char)*q)) ++q;
+    if(q == end || (*q != '"' && *q != '\''))
+      continue;
+    const char* valend = std::find(q + 1, end, *q);
+    if(valend != end && valend > q + 1)
+      ids.emplace_back(q + 1, valend);
+  }
+  return ids;
+}
+
+// LazyGroups: store source of <g> just opened by startElement() to be parsed on first access to children
+void SvgParser::readLazyGroup(XmlStreamReader* const xml)
+{
+  // limits can't be enforced for content parsed later
+  if(m_pushReader || m_hasLimits || m_limits.maxPathPoints || m_limits.maxImagePixels || m_limits.maxExternalDepth)
+    return;
+  const char* start;
+  const char* end;
+  if(!xml->readNodeSource(&start, &end))
+    return;  // not pull parsing
+  unsigned int opts = xml->pullOpts();
+  // <style> and <font> affect the rest of the document
+  if(size_t(end - start) < MIN_LAZY_GROUP_BYTES
+      || containsStr(start, end, "<style") || containsStr(start, end, "<font")) {
+    parseChildren(start, end - start, opts);
+    return;
+  }
+
+  SvgContainerNode* node = m_nodes.back()->asContainerNode();
+  SvgLazyContent* lazy = new SvgLazyContent;
+  lazy->source = XmlFragment(start, end - start);
+  lazy->ids = scanIds(start, end);
+  StringRef bboxstr(node->getStringAttr("data-bbox", ""));
+  std::vector<real>& bbox = parseNumbersList(bboxstr);
+  if(bbox.size() == 4 && bbox[2] >= 0 && bbox[3] >= 0)
+    lazy->bboxHint = Rect::ltwh(bbox[0], bbox[1], bbox[2], bbox[3]);
+  lazy->flags = m_flags;
+  lazy->opts = opts;
+  lazy->dpi = m_dpi;
+  lazy->emPx = currState().emPx;
+  lazy->fileName = m_fileName;
+  node->setLazyContent(lazy);
+  SvgDocument* doc = node->document();  // NULL if we are parsing lazy content of node not in a document
+  if(doc) {
+    for(const std::string& id : lazy->ids)
+      doc->m_lazyIds[id] = node;
+    doc->m_lazyState.hasIds.store(true, std::memory_order_release);
+  }
+  endElement(xml->name());
+}
+
+// parse content of m_nodes.back() from complete source of the element, whose start tag has already been
+//  processed by startElement()
+void SvgParser::parseChildren(const char* src, size_t len, unsigned int opts)
+{
+  size_t nnodes = m_nodes.size();
+  size_t nstates = m_states.size();
+  XmlStreamReader xml(src, int(len), opts | XmlStreamReader::PullParse);
+  while(xml.readNext() != XmlStreamReader::StartElement && !xml.atEnd()) {}
+  if(!xml.atEnd()) {
+    xml.readNext();  // skip start tag
+    parseTokens(&xml);
+  }
+  if(xml.parseStatus() != 0)
+    m_hasErrors = true;
+  // in case of error, restore state as if element was closed
+  if(m_nodes.size() >= nnodes) {
+    m_nodes.resize(nnodes - 1);
+    m_states.resize(nstates - 1);
+    m_inStyle = false;
+  }
+}
+
+// share identical attribute lists via SvgAttrSet table (SharedAttrs); lazy content is shared when parsed
+static void shareAttrs(SvgNode* node)
+{
+  node->attrs.share();
+  if(node->asContainerNode()) {
+    for(SvgNode* child : node->asContainerNode()->parsedChildren())
+      shareAttrs(child);
+  }
+  else if(node->type() == SvgNode::GRADIENT) {
+    for(SvgGradientStop* stop : static_cast<SvgGradient*>(node)->stops())
+      shareAttrs(stop);
+  }
+  else if(node->type() == SvgNode::TEXT || node->type() == SvgNode::TSPAN) {
+    for(SvgTspan* tspan : static_cast<SvgTspan*>(node)->tspans())
+      shareAttrs(tspan);
+  }
+}
+
+void SvgParser::parseLazyContent(SvgContainerNode* node, const SvgLazyContent& lazy)
+{
+  SvgParser parser;
+  parser.setFlags(lazy.flags).setFileName(lazy.fileName.c_str());
+  parser.setDpi(lazy.dpi);
+  // document is needed by parser, e.g., for resolving gradient links
+  std::unique_ptr<SvgDocument> tempdoc;
+  parser.m_doc = node->document();
+  if(!parser.m_doc) {
+    tempdoc.reset(new SvgDocument());
+    parser.m_doc = tempdoc.get();
+  }
+  parser.m_states.emplace_back();
+  parser.currState().emPx = lazy.emPx;
+  parser.m_states.emplace_back(parser.currState());  // state for node, popped by its end tag
+  parser.m_nodes.push_back(node);
+  parser.parseChildren(lazy.source.data(), lazy.source.size(), lazy.opts);
+  parser.parsePendingPaths();
+  parser.waitPendingLoads();
+  if(!parser.m_pendingImages.empty())
+    SvgImage::decodeInBackground(parser.m_pendingImages);
+  if(lazy.flags & SharedAttrs) {
+    for(SvgNode* child : node->parsedChildren())
+      shareAttrs(child);
+  }
+}
+
+// returns false if more data is needed (XmlStreamReader::PushParse), true if parsing is finished
+bool SvgParser::parseTokens(XmlStreamReader* const xml)
+{
+  SvgDocument* root = m_doc ? m_doc->rootDocument() : NULL;
+  SvgArena::Scope arenaScope(root ? root->arena() : NULL);
+  if(m_skipPending) {
+    if(!readUnknownNode(xml))
+      return false;
+    m_skipPending = false;
+    xml->readNext();
+  }
   bool done = false;
-  while(!xml->atEnd() && !done) {
+  while(!xml->atEnd() && !done && m_error.empty()) {
     // support XmlStreamReader already at start element (if not, no problem, will advance)
     switch(xml->tokenType()) {
+    case XmlStreamReader::NeedMoreData:
+      if(xml->readNext() == XmlStreamReader::NeedMoreData)
+        return false;
+      continue;  // process new token
     case XmlStreamReader::StartDocument:
       // this handles the case of the reader already opened on the <svg> node (instead of its parent)
       if(StringRef(xml->name()) != "svg")
         break;
     case XmlStreamReader::StartElement:
       if(!startElement(xml->name(), xml->attributes())) {
-        if(!m_doc)
-          return;
+        if(!m_doc || !m_error.empty())
+          return true;
         m_states.pop_back();
-        if(m_nodes.back()->asContainerNode())
-          m_nodes.back()->asContainerNode()->addChild(new SvgXmlFragment(xml->readNodeAsFragment()));
-        else
-          delete xml->readNodeAsFragment();  // read node to skip even if we can't add it to doc
+        if(!readUnknownNode(xml)) {
+          m_skipPending = true;
+          return false;
+        }
       }
+      else if((m_flags & LazyGroups) && !m_inStyle && m_nodes.back()->type() == SvgNode::G)
+        readLazyGroup(xml);
       break;
     // EndDocument means atEnd() returns true, so this never runs - maybe move below loop?
     //case XmlStreamReader::EndDocument:
@@ -1063,7 +1430,7 @@ void SvgParser::parse(XmlStreamReader* const xml)
       if(!m_nodes.empty()) {
         endElement(xml->name());
         // save a copy of style node as fragment to preserve it
-        if(StringRef(xml->name()) == "style" && m_nodes.back()->asContainerNode())
+        if(StringRef(xml->name()) == "style" && !(m_flags & DiscardUnknownNodes) && m_nodes.back()->asContainerNode())
           m_nodes.back()->asContainerNode()->addChild(new SvgXmlFragment(xml->readNodeAsFragment()));
       }
       done = m_nodes.empty();
@@ -1074,7 +1441,7 @@ void SvgParser::parse(XmlStreamReader* const xml)
     case XmlStreamReader::ProcessingInstruction:
     case XmlStreamReader::Comment:
       // should we support <?xml-stylesheet type="text/css" href="style.css"?> ?
-      if(m_nodes.back()->asContainerNode())
+      if(!(m_flags & DiscardUnknownNodes) && m_nodes.back()->asContainerNode())
         m_nodes.back()->asContainerNode()->addChild(new SvgXmlFragment(xml->readNodeAsFragment()));
       break;
     default:
@@ -1083,14 +1450,181 @@ void SvgParser::parse(XmlStreamReader* const xml)
     if(!done)
       xml->readNext();
   }
+  return true;
+}
+
+void SvgParser::finishParse(XmlStreamReader* const xml)
+{
+  if(m_error.empty())
+    parsePendingPaths();
+  m_pendingPaths.clear();
+  waitPendingLoads();
+  if(!m_error.empty()) {
+    PLATFORM_LOG("Parsing %s stopped: %s\n", m_fileName.empty() ? "SVG" : m_fileName.c_str(), m_error.c_str());
+    m_pendingImages.clear();
+    m_nodes.clear();
+    m_styleText.clear();
+    delete m_doc;
+    m_doc = NULL;
+    return;
+  }
 #ifndef NO_DYNAMIC_STYLE
-  if(m_doc && !m_stylesheet->rules().empty()) {
-    m_stylesheet->sort_rules();
-    m_doc->setStylesheet(std::move(m_stylesheet));
-    m_doc->restyle();
+  if(m_doc && !m_styleText.empty()) {
+    auto stylesheet = SvgCssStylesheet::fromText(m_styleText);
+    if(stylesheet) {
+      m_doc->setStylesheet(std::move(stylesheet));
+      SvgArena::Scope arenaScope(m_doc->arena());
+      m_doc->restyle();
+    }
   }
 #endif
+  m_styleText.clear();
+  if(m_doc && (m_flags & SharedAttrs))
+    shareAttrs(m_doc);
   m_hasErrors = xml->parseStatus() != 0;
+  // images are not accessed again by parser, so decode can start now
+  if(!m_pendingImages.empty()) {
+    SvgImage::decodeInBackground(m_pendingImages);
+    m_pendingImages.clear();
+  }
+}
+
+// join point for external resources loaded w/ AsyncResources
+void SvgParser::waitPendingLoads()
+{
+  for(PendingImage& pending : m_pendingLoads) {
+    LoadedImage loaded = pending.image.get();
+    if(!loaded.encoded.empty())
+      pending.node->m_encoded = std::make_shared<SvgImage::EncodedImage>(std::move(loaded.encoded));
+    else
+      pending.node->m_image = std::move(loaded.image);
+  }
+  m_pendingLoads.clear();
+  m_loadsWaited = 0;
+  if(m_limits.maxImagePixels && m_imagePixels > m_limits.maxImagePixels)
+    limitExceeded("image pixels", m_limits.maxImagePixels);
+  for(PendingUse& pending : m_pendingUses) {
+    ExternalDoc ext = pending.doc.get();
+    if(!ext.error.empty() && m_error.empty())
+      m_error = ext.error;
+    std::shared_ptr<SvgDocument> doc = std::move(ext.doc);
+    if(!doc)
+      continue;
+    if(!pending.id.empty())
+      pending.node->setExternalDoc(std::move(doc), pending.id.c_str());
+    else
+      pending.node->setExternalDoc(std::move(doc));
+  }
+  m_pendingUses.clear();
+  m_usesWaited = 0;
+}
+
+// resource limits
+
+SvgParser& SvgParser::setLimits(const Limits& limits)
+{
+  m_limits = limits;
+  m_hasLimits = limits.maxDepth || limits.maxNodes || limits.maxAttrBytes;  // limits checked per element
+  return *this;
+}
+
+bool SvgParser::limitExceeded(const char* what, size_t limit)
+{
+  if(m_error.empty())
+    m_error = std::string(what) + " limit of " + std::to_string(limit) + " exceeded";
+  return false;
+}
+
+bool SvgParser::checkElementLimits()
+{
+  if(m_limits.maxDepth && m_nodes.size() >= m_limits.maxDepth)
+    return limitExceeded("nesting depth", m_limits.maxDepth);
+  if(m_limits.maxNodes && ++m_nodeCount > m_limits.maxNodes)
+    return limitExceeded("node count", m_limits.maxNodes);
+  if(m_limits.maxAttrBytes) {
+    for(const NodeAttribute& attr : nodeAttributes)
+      m_attrBytes += strlen(attr.value);
+    if(m_attrBytes > m_limits.maxAttrBytes)
+      return limitExceeded("attribute bytes", m_limits.maxAttrBytes);
+  }
+  return true;
+}
+
+bool SvgParser::addPathPoints(size_t npoints)
+{
+  m_pathPoints += npoints;
+  return m_pathPoints <= m_limits.maxPathPoints || limitExceeded("path points", m_limits.maxPathPoints);
+}
+
+static uint32_t readBE16(const unsigned char* p) { return (p[0] << 8) | p[1]; }
+static uint32_t readBE32(const unsigned char* p) { return (uint32_t(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+static uint32_t readLE16(const unsigned char* p) { return p[0] | (p[1] << 8); }
+static uint32_t readLE32(const unsigned char* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24); }
+
+// get image size from header w/o decoding; returns SIZE_MAX if format is not recognized
+static size_t imageHeaderPixels(const unsigned char* data, size_t len)
+{
+  if(len >= 24 && memcmp(data, "\x89PNG", 4) == 0)
+    return size_t(readBE32(data + 16))*readBE32(data + 20);
+  if(len >= 10 && memcmp(data, "GIF8", 4) == 0)
+    return size_t(readLE16(data + 6))*readLE16(data + 8);
+  if(len >= 26 && data[0] == 'B' && data[1] == 'M')
+    return size_t(readLE32(data + 18))*size_t(std::abs(int64_t(int32_t(readLE32(data + 22)))));
+  if(len >= 4 && data[0] == 0xFF && data[1] == 0xD8) {
+    // find SOFn marker (excluding DHT, JPG, DAC)
+    size_t pos = 2;
+    while(pos + 9 <= len && data[pos] == 0xFF) {
+      unsigned char marker = data[pos+1];
+      if(marker == 0xFF) { ++pos;  continue; }
+      if(marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+        return size_t(readBE16(data + pos + 5))*readBE16(data + pos + 7);
+      pos += 2 + readBE16(data + pos + 2);
+    }
+  }
+  return SIZE_MAX;
+}
+
+// may be called from AsyncResources threads; m_imagePixels > maxImagePixels if limit is exceeded
+bool SvgParser::reserveImagePixels(const unsigned char* data, size_t len)
+{
+  if(!m_limits.maxImagePixels)
+    return true;
+  size_t npixels = std::min(imageHeaderPixels(data, len), m_limits.maxImagePixels + 1);
+  return m_imagePixels.fetch_add(npixels) + npixels <= m_limits.maxImagePixels;
+}
+
+// convert path data collected w/ ParallelPathData
+void SvgParser::parsePendingPaths()
+{
+  static constexpr size_t MIN_PATHS_PER_THREAD = 64;
+  static constexpr size_t PATHS_PER_BATCH = 16;
+  size_t npaths = m_pendingPaths.size();
+  if(npaths == 0)
+    return;
+  std::atomic<size_t> nextPath(0);
+  auto worker = [this, npaths, &nextPath](){
+    std::vector<real> points;
+    size_t ii;
+    while((ii = nextPath.fetch_add(PATHS_PER_BATCH)) < npaths) {
+      size_t end = std::min(ii + PATHS_PER_BATCH, npaths);
+      for(; ii < end; ++ii)
+        m_pendingPaths[ii]->parsePathData(points);
+    }
+  };
+  size_t nthreads = std::min(size_t(std::thread::hardware_concurrency()), npaths/MIN_PATHS_PER_THREAD);
+  std::vector<std::thread> threads;
+  for(size_t ii = 1; ii < nthreads; ++ii)
+    threads.emplace_back(worker);
+  worker();  // current thread does its share too
+  for(std::thread& t : threads)
+    t.join();
+  if(m_limits.maxPathPoints) {
+    for(SvgPath* path : m_pendingPaths) {
+      if(!addPathPoints(path->m_path.points.size()))
+        break;
+    }
+  }
+  m_pendingPaths.clear();
 }
 
 SvgDocument* SvgParser::parseXml(XmlStreamReader* reader)
@@ -1104,21 +1638,150 @@ SvgDocument* SvgParser::parseXml(XmlStreamReader* reader)
 // parse a document fragment
 SvgDocument* SvgParser::parseXmlFragment(XmlStreamReader* reader)
 {
+  SvgArena::Scope arenaScope(SvgArena::current);  // startElement() sets current for ArenaAlloc
   m_states.emplace_back();
   startElement("svg", XmlStreamAttributes());
   parse(reader);
-  endElement("svg");
+  // if a limit was exceeded, finishParse() has already deleted document
+  if(m_error.empty() && !m_nodes.empty())
+    endElement("svg");
   m_states.clear();
   return m_doc;
 }
 
-std::function<std::istream*(const char*)> SvgParser::openStream;
+SvgParser::OpenStreamFn SvgParser::defaultOpenStream;
+uint64_t SvgParser::defaultOpenStreamId = 0;
+
+// documents are keyed by absolute path and the parameters they were parsed with (see externalDocKey())
+struct ExternalDocCache
+{
+  struct Entry {
+    int64_t mtime;
+    std::weak_ptr<SvgDocument> doc;
+  };
+  std::mutex mutex;
+  std::unordered_map<std::string, Entry> docs;
+
+  static ExternalDocCache& instance() { static ExternalDocCache cache;  return cache; }
+};
+
+// id 0 is no handler; every handler gets a new id when set, so documents loaded through different handlers are
+//  never shared, while those loaded through the same handler are
+static std::atomic<uint64_t> nextOpenStreamId(1);
+
+void SvgParser::setDefaultOpenStream(OpenStreamFn fn)
+{
+  defaultOpenStream = std::move(fn);
+  defaultOpenStreamId = defaultOpenStream ? nextOpenStreamId++ : 0;
+}
+
+SvgParser& SvgParser::setOpenStream(OpenStreamFn fn)
+{
+  m_openStream = std::move(fn);
+  m_openStreamId = m_openStream ? nextOpenStreamId++ : 0;
+  return *this;
+}
+
+static std::string externalDocKey(const std::string& path, unsigned int flags, uint64_t streamid,
+    const SvgParser::Limits& limits, size_t depth)
+{
+  char params[256];
+  // depth only matters if maxExternalDepth is set
+  snprintf(params, sizeof(params), "|%x|%llu|%zu|%zu|%zu|%zu|%zu|%zu|%zu", flags, (unsigned long long)streamid,
+      limits.maxDepth, limits.maxNodes, limits.maxPathPoints, limits.maxAttrBytes, limits.maxExternalDepth,
+      limits.maxImagePixels, limits.maxExternalDepth ? depth : 0);
+  return path + params;
+}
+
+static int64_t fileModTime(const char* filename)
+{
+  struct stat st;
+  return stat(filename, &st) == 0 ? int64_t(st.st_mtime) : -1;
+}
+
+std::shared_ptr<SvgDocument> SvgParser::loadExternalDocument(const char* filename, unsigned int flags)
+{
+  return loadExternalDoc(filename, flags, defaultOpenStream, defaultOpenStreamId, Limits(), 0).doc;
+}
+
+std::shared_ptr<SvgDocument> SvgParser::loadExternal(const char* filename) const
+{
+  return loadExternalDoc(filename, m_flags, m_openStream, m_openStreamId, m_limits, m_extDepth + 1).doc;
+}
+
+// depth is external reference depth of document being loaded
+SvgParser::ExternalDoc SvgParser::loadExternalDoc(const char* filename, unsigned int flags,
+    const OpenStreamFn& openfn, uint64_t streamid, const Limits& limits, size_t depth)
+{
+  // shared documents may be drawn concurrently from multiple threads, so lazy content, which is parsed or
+  //  decoded by const accessors (e.g. path(), image(), children()), is not allowed
+  flags &= ~(LazyPathData | LazyImages | BackgroundImageDecode | LazyGroups);
+  std::string path(filename);
+#ifndef _WIN32
+  // so that, e.g., "a/../b.svg" and "b.svg" share an entry
+  char* resolved = realpath(filename, NULL);
+  if(resolved) {
+    path = resolved;
+    free(resolved);
+  }
+#endif
+  // file might not exist on disk if openStream is set - use mtime = -1 in that case
+  int64_t mtime = fileModTime(path.c_str());
+  std::string key = externalDocKey(path, flags, streamid, limits, depth);
+  ExternalDocCache& cache = ExternalDocCache::instance();
+  {
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    auto it = cache.docs.find(key);
+    if(it != cache.docs.end() && it->second.mtime == mtime) {
+      if(auto doc = it->second.doc.lock())
+        return {doc};
+    }
+  }
+  // do not hold lock while parsing, since document may reference other external documents
+  SvgParser parser;
+  parser.setFlags(flags).setLimits(limits);
+  parser.m_openStream = openfn;
+  parser.m_openStreamId = streamid;
+  parser.m_extDepth = depth;
+  std::shared_ptr<SvgDocument> doc(parser.parseFile(path.c_str()));
+  if(!doc)
+    return {nullptr, parser.error().empty() ? std::string() : path + ": " + parser.error()};
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  ExternalDocCache::Entry& entry = cache.docs[key];
+  // another thread may have loaded same file while we were parsing
+  auto existing = entry.mtime == mtime ? entry.doc.lock() : nullptr;
+  if(existing)
+    return {existing};
+  entry.mtime = mtime;
+  entry.doc = doc;
+  // drop entries for documents no longer in use
+  for(auto it = cache.docs.begin(); it != cache.docs.end();)
+    it = it->second.doc.expired() ? cache.docs.erase(it) : ++it;
+  return {doc};
+}
+
+void SvgParser::clearExternalDocuments()
+{
+  ExternalDocCache& cache = ExternalDocCache::instance();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  cache.docs.clear();
+}
 
 SvgDocument* SvgParser::parseFile(const char* filename, unsigned int opts)
 {
   ASSERT(filename && filename[0] && "filename cannot be empty!");
-  std::unique_ptr<std::istream> ifs(openStream ? openStream(filename) : new std::ifstream(PLATFORM_STR(filename)));
-  if(!*ifs) {
+  if(!m_openStream && (opts & (XmlStreamReader::BufferInPlace | XmlStreamReader::PullParse))) {
+    MappedFile mapped(filename);
+    if(!mapped.data) {
+      PLATFORM_LOG("Cannot open file '%s'\n", filename);
+      return NULL;
+    }
+    m_fileName = filename;
+    XmlStreamReader xml(mapped.data, mapped.size, opts);
+    return parseXml(&xml);
+  }
+  std::unique_ptr<std::istream> ifs(m_openStream ? m_openStream(filename) : new std::ifstream(PLATFORM_STR(filename)));
+  if(!ifs || !*ifs) {
     PLATFORM_LOG("Cannot open file '%s'\n", filename);
     return NULL;
   }
@@ -1144,10 +1807,603 @@ SvgDocument* SvgParser::parseFragment(const char* data, int len, unsigned int op
   return parseXmlFragment(&xml);
 }
 
-SvgParser::SvgParser()
+// incremental reparse
+
+// patches live document to match newly parsed copy, modifying only what changed
+struct SvgDocPatcher
+{
+  SvgDocument* doc;
+  // ids of changed nodes and their ancestors, for invalidating <use> and paint server references
+  std::unordered_set<std::string> changedIds;
+  // removed and unused nodes are deleted when finished so that pointers (e.g. gradient links) remain valid
+  std::vector<SvgNode*> discarded;
+
+  SvgDocPatcher(SvgDocument* d) : doc(d) {}
+  void patch(SvgDocument* newdoc);
+  bool patchNode(SvgNode* node, SvgNode* newnode);
+  void patchChildren(SvgContainerNode* node, SvgContainerNode* newnode);
+  bool patchAttrs(SvgNode* node, SvgNode* newnode);
+  bool sameContent(SvgNode* node, SvgNode* newnode);
+  void noteChanged(const SvgNode* node, bool subtree);
+  void updateRefs(SvgNode* node);
+};
+
+static bool sameReal(real a, real b) { return a == b || (a != a && b != b); }  // NaN == NaN
+
+static bool samePath(const Path2D& a, const Path2D& b)
+{
+  return a.commands == b.commands && a.points.size() == b.points.size() && std::equal(a.points.begin(),
+      a.points.end(), b.points.begin(), [](const Point& p, const Point& q){ return p.x == q.x && p.y == q.y; });
+}
+
+// id, class, transform, and non-CSS attributes
+static bool sameAttrs(const SvgNode* a, const SvgNode* b)
+{
+  const Transform2D& tfa = a->getTransform();
+  const Transform2D& tfb = b->getTransform();
+  if(a->m_id != b->m_id || a->m_class != b->m_class || !std::equal(tfa.m, tfa.m + 6, tfb.m))
+    return false;
+  size_t na = 0, nb = 0;
+  for(const SvgAttr& attr : b->attrs) {
+    if(attr.src() == SvgAttr::CSSSrc)
+      continue;
+    const SvgAttr* curr = a->getAttr(attr.name(), attr.src());
+    if(!curr || !(*curr == attr))
+      return false;
+    ++nb;
+  }
+  for(const SvgAttr& attr : a->attrs)
+    na += attr.src() != SvgAttr::CSSSrc ? 1 : 0;
+  return na == nb;
+}
+
+// tspans are not SvgContainerNode children, so they are compared (including attributes) here
+static bool sameText(const SvgTspan* a, const SvgTspan* b)
+{
+  if(a->type() != b->type() || a->m_isTspan != b->m_isTspan || a->m_text != b->m_text
+      || a->m_x != b->m_x || a->m_y != b->m_y || a->tspans().size() != b->tspans().size())
+    return false;
+  if(a->type() == SvgNode::TEXTPATH) {
+    auto tpa = static_cast<const SvgTextPath*>(a);
+    auto tpb = static_cast<const SvgTextPath*>(b);
+    if(strcmp(tpa->href(), tpb->href()) != 0 || tpa->startOffset() != tpb->startOffset())
+      return false;
+  }
+  for(size_t ii = 0; ii < a->tspans().size(); ++ii) {
+    if(!sameAttrs(a->tspans()[ii], b->tspans()[ii]) || !sameText(a->tspans()[ii], b->tspans()[ii]))
+      return false;
+  }
+  return true;
+}
+
+static bool sameFont(const SvgFont* a, const SvgFont* b)
+{
+  if(a->m_familyName != b->m_familyName || !sameReal(a->m_unitsPerEm, b->m_unitsPerEm)
+      || !sameReal(a->m_horizAdvX, b->m_horizAdvX) || a->m_glyphs.get().size() != b->m_glyphs.get().size()
+      || a->m_kerning.size() != b->m_kerning.size() || !a->fontFace() != !b->fontFace()
+      || (a->fontFace() && !sameAttrs(a->fontFace(), b->fontFace())))
+    return false;
+  for(size_t ii = 0; ii < a->m_glyphs.get().size(); ++ii) {
+    const SvgGlyph* ga = a->m_glyphs.get()[ii];
+    const SvgGlyph* gb = b->m_glyphs.get()[ii];
+    if(ga->m_name != gb->m_name || ga->m_unicode != gb->m_unicode || !sameReal(ga->m_horizAdvX, gb->m_horizAdvX)
+        || !samePath(ga->m_path, gb->m_path) || !sameAttrs(ga, gb))
+      return false;
+  }
+  for(size_t ii = 0; ii < a->m_kerning.size(); ++ii) {
+    const SvgFont::Kerning& ka = a->m_kerning[ii];
+    const SvgFont::Kerning& kb = b->m_kerning[ii];
+    if(ka.g1 != kb.g1 || ka.g2 != kb.g2 || ka.u1 != kb.u1 || ka.u2 != kb.u2 || !sameReal(ka.k, kb.k))
+      return false;
+  }
+  return true;
+}
+
+static bool sameGradient(const SvgGradient* a, const SvgGradient* b)
+{
+  const Gradient& ga = a->m_gradient;
+  const Gradient& gb = b->m_gradient;
+  // spreadMethod and color-interpolation are consumed by parser, so not in attrs
+  if(ga.type != gb.type || ga.coordinateMode() != gb.coordinateMode() || ga.spread() != gb.spread()
+      || ga.colorInterp() != gb.colorInterp() || a->stops().size() != b->stops().size())
+    return false;
+  if(ga.type == Gradient::Linear) {
+    const Gradient::LinearGradCoords& la = ga.coords.linear;
+    const Gradient::LinearGradCoords& lb = gb.coords.linear;
+    if(la.x1 != lb.x1 || la.y1 != lb.y1 || la.x2 != lb.x2 || la.y2 != lb.y2)
+      return false;
+  }
+  else if(ga.type == Gradient::Radial) {
+    const Gradient::RadialGradCoords& ra = ga.coords.radial;
+    const Gradient::RadialGradCoords& rb = gb.coords.radial;
+    if(ra.cx != rb.cx || ra.cy != rb.cy || ra.radius != rb.radius || ra.fx != rb.fx || ra.fy != rb.fy)
+      return false;
+  }
+  for(size_t ii = 0; ii < a->stops().size(); ++ii) {
+    if(!sameAttrs(a->stops()[ii], b->stops()[ii]))
+      return false;
+  }
+  const SvgGradient* link = a->m_link;
+  const SvgGradient* newlink = b->m_link;
+  return strcmp(link ? link->xmlId() : "", newlink ? newlink->xmlId() : "") == 0;
+}
+
+// data URI (kept by non-lazy image that couldn't be decoded) is compared by content, not as a link
+static const char* imageFileLink(const SvgImage* node)
+{
+  return node->m_linkStr.compare(0, 5, "data:") == 0 ? "" : node->m_linkStr.c_str();
+}
+
+static bool sameImage(const SvgImage* a, const SvgImage* b)
+{
+  if(strcmp(imageFileLink(a), imageFileLink(b)) != 0 || a->m_bounds != b->m_bounds || a->srcRect != b->srcRect)
+    return false;
+  if(imageFileLink(a)[0])
+    return true;  // linked image is not reloaded
+  if(a->m_encoded && b->m_encoded) {
+    std::lock_guard<std::mutex> locka(a->m_encoded->mutex);
+    std::lock_guard<std::mutex> lockb(b->m_encoded->mutex);
+    if(!a->m_encoded->data.empty() && !b->m_encoded->data.empty())
+      return a->m_encoded->data == b->m_encoded->data;
+  }
+  return !(*a->image() != *b->image());
+}
+
+static int patchKeyType(const SvgNode* node)
+{
+  return node->type() == SvgNode::G ? static_cast<const SvgG*>(node)->groupType : node->type();
+}
+
+static bool samePatchKey(const SvgNode* a, const SvgNode* b)
+{
+  return patchKeyType(a) == patchKeyType(b) && strcmp(a->xmlId(), b->xmlId()) == 0;
+}
+
+// match[j] is set to index in olds of node matching news[j]; matches preserve order, so unchanged children are
+//  never moved - common prefix and suffix are matched directly, then LCS (by id and type) is used for the rest
+static void alignChildren(const std::vector<SvgNode*>& olds, const std::vector<SvgNode*>& news, std::vector<int>& match)
+{
+  static constexpr size_t MAX_LCS_CELLS = size_t(1) << 22;
+  size_t n = olds.size(), m = news.size();
+  size_t pre = 0, suf = 0;
+  for(; pre < n && pre < m && samePatchKey(olds[pre], news[pre]); ++pre)
+    match[pre] = int(pre);
+  for(; suf < n - pre && suf < m - pre && samePatchKey(olds[n-1-suf], news[m-1-suf]); ++suf)
+    match[m-1-suf] = int(n-1-suf);
+  size_t n1 = n - pre - suf, m1 = m - pre - suf;
+  if(n1 == 0 || m1 == 0)
+    return;
+  if(n1*m1 > MAX_LCS_CELLS) {
+    for(size_t k = 0; k < std::min(n1, m1); ++k) {
+      if(samePatchKey(olds[pre+k], news[pre+k]))
+        match[pre+k] = int(pre+k);
+    }
+    return;
+  }
+  std::vector<uint32_t> lcs((n1 + 1)*(m1 + 1), 0);
+  auto L = [&lcs, m1](size_t i, size_t j) -> uint32_t& { return lcs[i*(m1 + 1) + j]; };
+  for(size_t i = n1; i-- > 0;) {
+    for(size_t j = m1; j-- > 0;)
+      L(i, j) = samePatchKey(olds[pre+i], news[pre+j]) ? L(i+1, j+1) + 1 : std::max(L(i+1, j), L(i, j+1));
+  }
+  for(size_t i = 0, j = 0; i < n1 && j < m1;) {
+    if(samePatchKey(olds[pre+i], news[pre+j])) {
+      match[pre+j] = int(pre+i);
+      ++i;  ++j;
+    }
+    else if(L(i+1, j) >= L(i, j+1))
+      ++i;
+    else
+      ++j;
+  }
+}
+
+void SvgDocPatcher::noteChanged(const SvgNode* node, bool subtree)
+{
+  for(const SvgNode* n = node->parent(); n; n = n->parent()) {
+    if(n->xmlId()[0])
+      changedIds.insert(n->xmlId());
+  }
+  std::function<void(const SvgNode*)> addIds = [&](const SvgNode* n){
+    if(n->xmlId()[0])
+      changedIds.insert(n->xmlId());
+    const SvgContainerNode* container = subtree ? n->asContainerNode() : NULL;
+    if(container) {
+      if(container->m_lazy)
+        changedIds.insert(container->m_lazy->ids.begin(), container->m_lazy->ids.end());
+      for(const SvgNode* child : container->parsedChildren())
+        addIds(child);
+    }
+  };
+  addIds(node);
+}
+
+// CSS attributes are left for restyle()
+bool SvgDocPatcher::patchAttrs(SvgNode* node, SvgNode* newnode)
+{
+  bool changed = false;
+  if(node->m_id != newnode->m_id) {
+    node->setXmlId(newnode->xmlId());
+    changed = true;
+  }
+  if(node->m_class != newnode->m_class) {
+    node->setXmlClass(newnode->xmlClass());
+    changed = true;
+  }
+  const Transform2D& tf = node->getTransform();
+  const Transform2D& newtf = newnode->getTransform();
+  if(!std::equal(tf.m, tf.m + 6, newtf.m)) {
+    if(newnode->hasTransform())
+      node->setTransform(newtf);
+    else {
+      node->transform.reset();
+      node->invalidate(true);
+    }
+    changed = true;
+  }
+  for(const SvgAttr& attr : newnode->attrs) {
+    if(attr.src() == SvgAttr::CSSSrc)
+      continue;
+    const SvgAttr* curr = node->getAttr(attr.name(), attr.src());
+    if(!curr || !(*curr == attr)) {
+      node->setAttr(attr);
+      changed = true;
+    }
+  }
+  std::vector< std::pair<std::string, int> > removed;
+  for(const SvgAttr& attr : node->attrs) {
+    if(attr.src() != SvgAttr::CSSSrc && !newnode->getAttr(attr.name(), attr.src()))
+      removed.emplace_back(attr.name(), attr.src());
+  }
+  for(auto& attr : removed)
+    node->removeAttr(attr.first.c_str(), attr.second);
+  return changed || !removed.empty();
+}
+
+// compare everything other than attributes and children
+bool SvgDocPatcher::sameContent(SvgNode* node, SvgNode* newnode)
+{
+  switch(node->type()) {
+  case SvgNode::IMAGE:
+    return sameImage(static_cast<SvgImage*>(node), static_cast<SvgImage*>(newnode));
+  case SvgNode::RECT:
+  {
+    auto r = static_cast<SvgRect*>(node);
+    auto newr = static_cast<SvgRect*>(newnode);
+    if(r->m_rect != newr->m_rect || r->m_rx != newr->m_rx || r->m_ry != newr->m_ry
+        || !std::equal(r->m_radii, r->m_radii + 4, newr->m_radii))
+      return false;
+  }  // fall through
+  case SvgNode::PATH:
+  {
+    auto path = static_cast<SvgPath*>(node);
+    auto newpath = static_cast<SvgPath*>(newnode);
+    if(path->pathType() != newpath->pathType())
+      return false;
+    // compare unparsed data if both are lazy
+    if(!path->pathData().empty() && !newpath->pathData().empty())
+      return path->pathData() == newpath->pathData();
+    return samePath(*path->path(), *newpath->path());
+  }
+  case SvgNode::USE:
+  {
+    auto use = static_cast<SvgUse*>(node);
+    auto newuse = static_cast<SvgUse*>(newnode);
+    return strcmp(use->href(), newuse->href()) == 0 && use->viewport() == newuse->viewport();
+  }
+  case SvgNode::TEXT:
+  case SvgNode::TSPAN:
+  case SvgNode::TEXTPATH:
+    return sameText(static_cast<SvgTspan*>(node), static_cast<SvgTspan*>(newnode));
+  case SvgNode::GRADIENT:
+    return sameGradient(static_cast<SvgGradient*>(node), static_cast<SvgGradient*>(newnode));
+  case SvgNode::FONT:
+    return sameFont(static_cast<SvgFont*>(node), static_cast<SvgFont*>(newnode));
+  case SvgNode::PATTERN:
+  {
+    auto pat = static_cast<SvgPattern*>(node);
+    auto newpat = static_cast<SvgPattern*>(newnode);
+    return pat->m_cell == newpat->m_cell && pat->m_patternUnits == newpat->m_patternUnits
+        && pat->m_patternContentUnits == newpat->m_patternContentUnits;
+  }
+  case SvgNode::UNKNOWN:
+  {
+    const XmlFragment* frag = static_cast<SvgXmlFragment*>(node)->fragment.get();
+    const XmlFragment* newfrag = static_cast<SvgXmlFragment*>(newnode)->fragment.get();
+    return frag->size() == newfrag->size() && memcmp(frag->data(), newfrag->data(), frag->size()) == 0;
+  }
+  default:
+    return true;  // everything else is in attributes (custom node extensions are not compared)
+  }
+}
+
+// returns false if node must be replaced by newnode
+bool SvgDocPatcher::patchNode(SvgNode* node, SvgNode* newnode)
+{
+  bool changed = patchAttrs(node, newnode);
+  SvgContainerNode* container = node->asContainerNode();
+  if(!container) {
+    if(!sameContent(node, newnode))
+      return false;
+  }
+  else {
+    SvgContainerNode* newcontainer = newnode->asContainerNode();
+    if(node->type() == SvgNode::DOC) {
+      // top-level doc can't be replaced, so update directly
+      SvgDocument* d = static_cast<SvgDocument*>(node);
+      SvgDocument* newd = static_cast<SvgDocument*>(newnode);
+      if(d->m_x != newd->m_x || d->m_y != newd->m_y || d->preserveAspectRatio() != newd->preserveAspectRatio()) {
+        d->m_x = newd->m_x;
+        d->m_y = newd->m_y;
+        d->setPreserveAspectRatio(newd->preserveAspectRatio());
+        d->invalidate(true);
+        changed = true;
+      }
+      if(d->m_width != newd->m_width || d->m_height != newd->m_height || d->viewBox() != newd->viewBox()) {
+        d->setWidth(newd->m_width);
+        d->setHeight(newd->m_height);
+        d->setViewBox(newd->viewBox());
+        changed = true;
+      }
+    }
+    else if(node->type() == SvgNode::PATTERN && !sameContent(node, newnode))
+      return false;
+
+    // unchanged lazy content doesn't need to be parsed
+    SvgLazyContent* lazy = container->m_lazy.get();
+    SvgLazyContent* newlazy = newcontainer->m_lazy.get();
+    if(!lazy || !newlazy || lazy->source.size() != newlazy->source.size()
+        || memcmp(lazy->source.data(), newlazy->source.data(), lazy->source.size()) != 0)
+      patchChildren(container, newcontainer);
+  }
+  if(changed)
+    noteChanged(node, false);
+  return true;
+}
+
+// we take ownership of newnode's children
+void SvgDocPatcher::patchChildren(SvgContainerNode* node, SvgContainerNode* newnode)
+{
+  std::vector<SvgNode*> olds(node->children().begin(), node->children().end());
+  std::vector<SvgNode*> news(newnode->children().begin(), newnode->children().end());
+  newnode->children().clear();
+  std::vector<int> match(news.size(), -1);
+  alignChildren(olds, news, match);
+
+  std::vector<bool> matched(olds.size(), false);
+  for(int ii : match) {
+    if(ii >= 0)
+      matched[ii] = true;
+  }
+  for(size_t ii = 0; ii < olds.size(); ++ii) {
+    if(!matched[ii]) {
+      noteChanged(olds[ii], true);
+      node->removeChild(olds[ii]);
+      discarded.push_back(olds[ii]);
+    }
+  }
+  // work backwards so we have the following node for inserting
+  SvgNode* next = NULL;
+  for(size_t jj = news.size(); jj-- > 0;) {
+    SvgNode* newchild = news[jj];
+    if(match[jj] >= 0) {
+      SvgNode* child = olds[match[jj]];
+      if(patchNode(child, newchild)) {
+        discarded.push_back(newchild);
+        next = child;
+        continue;
+      }
+      noteChanged(child, true);
+      node->removeChild(child);
+      discarded.push_back(child);
+    }
+    node->addChild(newchild, next);
+    noteChanged(newchild, true);
+    next = newchild;
+  }
+}
+
+// update links and invalidate nodes referencing changed nodes
+void SvgDocPatcher::updateRefs(SvgNode* node)
+{
+  if(node->type() == SvgNode::GRADIENT && static_cast<SvgGradient*>(node)->m_link) {
+    // link may be to node that was replaced or to node in new document
+    SvgGradient* grad = static_cast<SvgGradient*>(node);
+    SvgNode* link = doc->namedNode(grad->m_link->xmlId());
+    SvgGradient* target = link && link->type() == SvgNode::GRADIENT ? static_cast<SvgGradient*>(link) : NULL;
+    if(grad->m_link != target) {
+      grad->setStopLink(target);
+      grad->m_link_generation = 0;
+      grad->m_gradient.clearStops();
+    }
+  }
+  else if(node->type() == SvgNode::USE) {
+    const char* href = static_cast<SvgUse*>(node)->href();
+    if(href[0] == '#' && changedIds.count(href + 1))
+      node->invalidate(false);
+  }
+  if(!changedIds.empty()) {
+    const char* fill = node->getStringAttr(SvgAttr::FILL);
+    const char* stroke = node->getStringAttr(SvgAttr::STROKE);
+    if((fill && fill[0] == '#' && changedIds.count(fill + 1))
+        || (stroke && stroke[0] == '#' && changedIds.count(stroke + 1)))
+      node->setDirty(SvgNode::PIXELS_DIRTY);
+  }
+  if(node->asContainerNode()) {
+    for(SvgNode* child : node->asContainerNode()->parsedChildren())
+      updateRefs(child);
+  }
+}
+
+static void collectStyleSource(const SvgNode* node, std::string& out)
+{
+  if(node->type() == SvgNode::UNKNOWN) {
+    const XmlFragment* frag = static_cast<const SvgXmlFragment*>(node)->fragment.get();
+    if(frag->name() == "style")
+      out.append(frag->data(), frag->size());
+  }
+  else if(node->asContainerNode()) {
+    for(const SvgNode* child : node->asContainerNode()->parsedChildren())
+      collectStyleSource(child, out);
+  }
+}
+
+static void addSvgFonts(SvgDocument* doc, SvgNode* node)
+{
+  if(node->type() == SvgNode::FONT && static_cast<SvgFont*>(node)->familyName()[0])
+    doc->addSvgFont(static_cast<SvgFont*>(node));
+  else if(node->asContainerNode()) {
+    for(SvgNode* child : node->asContainerNode()->parsedChildren())
+      addSvgFonts(doc, child);
+  }
+}
+
+void SvgDocPatcher::patch(SvgDocument* newdoc)
+{
+  std::string oldstyle, newstyle;
+  collectStyleSource(doc, oldstyle);
+  collectStyleSource(newdoc, newstyle);
+
+  patchNode(doc, newdoc);  // always returns true for SvgDocument
+
+  if(!doc->m_fonts.empty() || !newdoc->m_fonts.empty()) {
+    doc->m_fonts.clear();
+    addSvgFonts(doc, doc);
+  }
+#ifndef NO_DYNAMIC_STYLE
+  // w/ DiscardUnknownNodes, we can't tell if stylesheet changed
+  if(oldstyle != newstyle || (newstyle.empty() && newdoc->m_stylesheet)) {
+    doc->setStylesheet(newdoc->m_stylesheet);
+    doc->restyle();
+  }
+#endif
+  updateRefs(doc);
+  for(SvgNode* node : discarded)
+    delete node;
+}
+
+bool SvgParser::patchDocument(SvgDocument* doc, SvgDocument* newdoc)
+{
+  if(!newdoc)
+    return false;
+  SvgDocPatcher(doc).patch(newdoc);
+  delete newdoc;
+  return true;
+}
+
+// LazyImages is used so embedded images can be compared w/o decoding
+bool SvgParser::reparseFile(SvgDocument* doc, const char* filename, unsigned int opts)
+{
+  unsigned int flags = m_flags;
+  m_flags |= LazyImages;
+  SvgDocument* newdoc = parseFile(filename, opts);
+  m_flags = flags;
+  return patchDocument(doc, newdoc);
+}
+
+bool SvgParser::reparseString(SvgDocument* doc, const char* data, int len, unsigned int opts)
+{
+  unsigned int flags = m_flags;
+  m_flags |= LazyImages;
+  SvgDocument* newdoc = parseString(data, len, opts);
+  m_flags = flags;
+  return patchDocument(doc, newdoc);
+}
+
+void SvgParser::startPush(unsigned int opts)
+{
+  m_pushReader.reset(new XmlStreamReader(NULL, 0, opts | XmlStreamReader::PushParse));
+  m_pushDone = false;
+  m_states.emplace_back();
+}
+
+bool SvgParser::pushData(const char* data, size_t len)
+{
+  if(!m_pushReader)
+    return false;
+  if(!m_pushDone) {
+    m_pushReader->appendData(data, len);
+    m_pushDone = parseTokens(m_pushReader.get());
+  }
+  return m_pushReader->parseStatus() == 0 && m_error.empty();
+}
+
+SvgDocument* SvgParser::finishPush()
+{
+  if(!m_pushReader)
+    return NULL;
+  m_pushReader->finishData();
+  if(!m_pushDone)
+    parseTokens(m_pushReader.get());
+  finishParse(m_pushReader.get());
+  m_pushReader.reset();
+  m_states.clear();
+  return m_doc;
+}
+
+// run fn(ii) for ii in [0, n) on up to nthreads threads
+template<typename F>
+static void parallelFor(size_t n, int nthreads, F fn)
+{
+  size_t maxthreads = nthreads > 0 ? size_t(nthreads) : size_t(std::thread::hardware_concurrency());
+  std::atomic<size_t> next(0);
+  auto worker = [n, &next, &fn](){
+    size_t ii;
+    while((ii = next.fetch_add(1)) < n)
+      fn(ii);
+  };
+  std::vector<std::thread> threads;
+  for(size_t ii = 1; ii < std::min(maxthreads, n); ++ii)
+    threads.emplace_back(worker);
+  worker();
+  for(std::thread& t : threads)
+    t.join();
+}
+
+static void finishBatchResult(SvgParser& parser, SvgParser::BatchResult& res, SvgDocument* doc)
+{
+  res.doc = doc;
+  if(!doc)
+    res.error = parser.error().empty() ? "Cannot open file" : parser.error();
+  else if(parser.hasErrors())
+    res.error = "XML parse error";
+}
+
+std::vector<SvgParser::BatchResult> SvgParser::parseFiles(const std::vector<std::string>& filenames,
+    unsigned int opts, unsigned int flags, int nthreads)
+{
+  std::vector<BatchResult> results(filenames.size());
+  parallelFor(filenames.size(), nthreads, [&](size_t ii){
+    SvgParser parser;
+    // ParallelPathData would oversubscribe cores when already parsing one document per thread
+    parser.setFlags(flags & ~ParallelPathData);
+    finishBatchResult(parser, results[ii], parser.parseFile(filenames[ii].c_str(), opts));
+  });
+  return results;
+}
+
+std::vector<SvgParser::BatchResult> SvgParser::parseStrings(const std::vector<StringRef>& buffers,
+    unsigned int opts, unsigned int flags, int nthreads)
+{
+  std::vector<BatchResult> results(buffers.size());
+  parallelFor(buffers.size(), nthreads, [&](size_t ii){
+    SvgParser parser;
+    parser.setFlags(flags & ~ParallelPathData);
+    // parseString() treats len = 0 as null terminated, but buffer might not be
+    if(buffers[ii].isEmpty()) {
+      results[ii].error = "Empty input";
+      return;
+    }
+    // BufferInPlace would modify caller's buffer
+    unsigned int bufopts = opts & ~XmlStreamReader::BufferInPlace;
+    finishBatchResult(parser, results[ii], parser.parseString(buffers[ii].constData(), buffers[ii].size(), bufopts));
+  });
+  return results;
+}
+
+SvgParser::SvgParser() : m_openStream(defaultOpenStream), m_openStreamId(defaultOpenStreamId)
 {
   m_nodes.reserve(32);
   m_states.reserve(32);
   numberList.reserve(4096);
-  m_stylesheet.reset(new SvgCssStylesheet);
 }
@@ -1,14 +1,31 @@
 #pragma once
 
 #include <functional>
+#include <future>
+#include <atomic>
 #include "svgnode.h"
 #include "svgstyleparser.h"
 #include "svgxml.h"
 
+// unparsed content of container created w/ SvgParser::LazyGroups
+struct SvgLazyContent
+{
+  XmlFragment source;  // complete source of element, including its start tag
+  std::vector<std::string> ids;  // ids found in source, so SvgDocument::namedNode() can parse content on demand
+  Rect bboxHint;  // from data-bbox attribute, if present
+  unsigned int flags;
+  unsigned int opts;
+  real dpi;
+  real emPx;
+  std::string fileName;
+};
+
 class SvgParser
 {
 public:
   SvgParser();
+  // opts are passed to XmlStreamReader - use XmlStreamReader::PullParse to parse w/o building XML DOM; for
+  //  parseFile, BufferInPlace or PullParse will memory map the file (unless openStream is set)
   SvgDocument* parseFile(const char* filename, unsigned int opts = XmlStreamReader::ParseDefault);
   SvgDocument* parseStream(std::istream& strm, unsigned int opts = XmlStreamReader::ParseDefault);
   SvgDocument* parseString(const char* data, int len = 0, unsigned int opts = XmlStreamReader::ParseDefault);
@@ -16,8 +33,27 @@ public:
   SvgDocument* parseXml(XmlStreamReader* reader);
   SvgDocument* parseXmlFragment(XmlStreamReader* reader);
 
+  // reparse changed source of doc (e.g., after file is modified by another program) and patch doc in place:
+  //  nodes are matched by id, type, and position, and only changed attributes and nodes are updated (w/
+  //  setAttr(), addChild(), removeChild(), etc.), so cached bounds, extensions, and dirty state are preserved for
+  //  unchanged nodes and the next dirty rect only covers what changed.  Returns false, leaving doc unchanged, if
+  //  source can't be parsed.  Linked images and external documents are not reloaded if href is unchanged
+  bool reparseFile(SvgDocument* doc, const char* filename, unsigned int opts = XmlStreamReader::ParseDefault);
+  bool reparseString(SvgDocument* doc, const char* data, int len = 0,
+      unsigned int opts = XmlStreamReader::ParseDefault);
+
+  // push parsing: call pushData() w/ each chunk of input as it arrives, then finishPush() to get document; nodes
+  //  are created as soon as their start tag is received, so partial document() can be used between calls (but
+  //  CSS is not applied and ParallelPathData, AsyncResources, and BackgroundImageDecode work is deferred until
+  //  finishPush()); pushData() returns false on parse error or if a limit is exceeded
+  void startPush(unsigned int opts = XmlStreamReader::ParseDefault);
+  bool pushData(const char* data, size_t len);
+  SvgDocument* finishPush();
+
   SvgDocument* document() const { return m_doc; }
   bool hasErrors() const { return !m_doc || m_hasErrors; }
+  // description of exceeded limit (see Limits); empty if no limit was exceeded
+  const std::string& error() const { return m_error; }
   const std::string& fileName() const { return m_fileName; }
   SvgParser& setFileName(const char* s) { m_fileName = s;  return *this; }  // for loading fragments
 
@@ -29,8 +65,85 @@ public:
   real dpi() const { return m_dpi; }
   void setDpi(real dpi) { m_dpi = dpi; }
 
-  // optional handler to return stream for a file name - to support, e.g., embedded resources
-  static std::function<std::istream*(const char*)> openStream;
+  // LazyPathData: <path> 'd' string is stored and only parsed on first call to SvgPath::path() (under same
+  //  per-document lock as LazyGroups, so document can be drawn from multiple threads)
+  // ParallelPathData: <path> 'd' strings are collected while parsing and converted on worker threads before
+  //  parse returns (ignored if LazyPathData is set)
+  // LazyImages: <image> data is read but not decoded until first call to SvgImage::image(); for a data URI, only
+  //  the base64-decoded bytes are kept
+  // BackgroundImageDecode: lazy images are decoded on background threads started when parse returns (implies
+  //  LazyImages)
+  // AsyncResources: linked <image> files and external <use> documents are loaded concurrently on other threads as
+  //  hrefs are found; all loads are complete before parse returns
+  // DiscardUnknownNodes: unrecognized elements, comments, processing instructions, and <style> elements are
+  //  not kept for writing (CSS is still applied) - for documents that will not be saved.  Note that comments
+  //  and PIs are only read if pugi::parse_comments and pugi::parse_pi are included in opts
+  // LazyGroups: content of large <g> elements is stored as source and only parsed on first call to children()
+  //  (including drawing the group, unless culled by dirty rect) or when an id inside is requested.  An optional
+  //  data-bbox="x y w h" attribute (local coords, including stroke) gives the group's bounds w/o parsing it.
+  //  Only used w/ XmlStreamReader::PullParse and ignored if any limits are set; groups containing <style> or
+  //  <font> are always parsed immediately.  Content is parsed under a lock per (root) document, so a document can
+  //  be drawn from multiple threads, but should not be modified while being drawn
+  // ArenaAlloc: nodes and attributes are allocated from an SvgArena owned by the document, for fewer heap
+  //  allocations and better locality; teardown still runs every destructor.  Nodes later added to the document
+  //  are allocated from the arena only while it is SvgArena::current (e.g., during parsing of LazyGroups content)
+  // SharedAttrs: after parsing, identical attribute lists (e.g., repeated icon or glyph elements) are shared
+  //  between nodes via a global hash-consing table; a node's list is copied the first time it is modified
+  enum Flags { LazyPathData = 0x1, ParallelPathData = 0x2, LazyImages = 0x4, BackgroundImageDecode = 0x8,
+      AsyncResources = 0x10, DiscardUnknownNodes = 0x20, LazyGroups = 0x40, ArenaAlloc = 0x80, SharedAttrs = 0x100 };
+  unsigned int flags() const { return m_flags; }
+  SvgParser& setFlags(unsigned int f) { m_flags = f;  return *this; }
+
+  // limits for parsing untrusted input; 0 means no limit.  If a limit is exceeded, parsing stops and NULL is
+  //  returned, with error() describing the limit.  maxAttrBytes is total size of attribute values, so also
+  //  bounds data URIs and, w/ LazyPathData, unparsed path data; maxPathPoints is total for all paths;
+  //  maxExternalDepth is length of chain of external documents referenced by <use>; maxImagePixels is total
+  //  for all images, read from PNG, JPEG, GIF, or BMP header before decoding (other formats exceed the limit).
+  //  Limits apply to each document separately: every external document referenced by <use> gets a full budget
+  //  (cached external documents are shared between parsers), so totals including external documents are not
+  //  bounded; maxExternalDepth only limits how deep chains of external references are followed.  LazyPathData
+  //  is ignored if maxPathPoints is set, and LazyGroups is ignored if any limit is set.
+  struct Limits {
+    size_t maxDepth = 0;
+    size_t maxNodes = 0;
+    size_t maxPathPoints = 0;
+    size_t maxAttrBytes = 0;
+    size_t maxExternalDepth = 0;
+    size_t maxImagePixels = 0;
+  };
+  const Limits& limits() const { return m_limits; }
+  SvgParser& setLimits(const Limits& limits);
+
+  typedef std::function<std::istream*(const char*)> OpenStreamFn;
+  // optional handler to return stream for a file name - to support, e.g., embedded resources.  A handler gets an
+  //  id when it is set, which identifies it in the external document cache, so documents loaded through the same
+  //  handler are shared.  The default handler is copied by the SvgParser constructor, so should only be set before
+  //  any parsing starts
+  static void setDefaultOpenStream(OpenStreamFn fn);
+  SvgParser& setOpenStream(OpenStreamFn fn);
+
+  // external documents referenced by <use> (or <image> w/ .svg href) are parsed once and shared; the cache only
+  //  holds weak references, keyed by absolute path, file modification time (so a changed file is reparsed),
+  //  flags, limits, and openStream handler.  Since shared documents can be drawn from multiple threads, they
+  //  are always parsed completely (LazyPathData, LazyImages, BackgroundImageDecode, and LazyGroups are ignored)
+  static std::shared_ptr<SvgDocument> loadExternalDocument(const char* filename, unsigned int flags = 0);
+  // load w/ openStream handler, flags, and limits of this parser
+  std::shared_ptr<SvgDocument> loadExternal(const char* filename) const;
+  static void clearExternalDocuments();
+
+  // parse content stored w/ LazyGroups into node; called by SvgContainerNode on first access to children
+  static void parseLazyContent(SvgContainerNode* node, const SvgLazyContent& lazy);
+
+  // batch parsing on a pool of nthreads threads (0 for hardware_concurrency()); results are in input order and
+  //  caller takes ownership of docs; error is empty on success
+  struct BatchResult {
+    SvgDocument* doc = NULL;
+    std::string error;
+  };
+  static std::vector<BatchResult> parseFiles(const std::vector<std::string>& filenames,
+      unsigned int opts = XmlStreamReader::ParseDefault, unsigned int flags = 0, int nthreads = 0);
+  static std::vector<BatchResult> parseStrings(const std::vector<StringRef>& buffers,
+      unsigned int opts = XmlStreamReader::ParseDefault, unsigned int flags = 0, int nthreads = 0);
 
 private:
   struct State {
@@ -43,6 +156,11 @@ private:
   State& currState() { return m_states.back(); }
 
   real m_dpi = SvgLength::defaultDpi;
+  unsigned int m_flags = 0;
+  OpenStreamFn m_openStream;
+  uint64_t m_openStreamId = 0;  // identifies handler in external document cache key
+  static OpenStreamFn defaultOpenStream;
+  static uint64_t defaultOpenStreamId;
 
   struct NodeAttribute {
     const char* name;
@@ -50,14 +168,69 @@ private:
     NodeAttribute(const char* n, const char* v) : name(n), value(v) {}
   };
   std::vector<NodeAttribute> nodeAttributes;
+  // open addressing hash table of {name hash, index into nodeAttributes} - only used for elements w/ many attrs
+  std::vector<std::pair<unsigned int, int>> attrIndex;
   int numUsedAttributes = 0;
   std::vector<real> numberList;
+  std::vector<SvgPath*> m_pendingPaths;
+  std::vector<SvgImage*> m_pendingImages;
+  std::vector<unsigned char> m_imageBuff;
+  struct ExternalDoc {
+    std::shared_ptr<SvgDocument> doc;
+    std::string error;  // limit exceeded while parsing doc
+  };
+  struct PendingUse {
+    SvgUse* node;
+    std::string id;
+    std::future<ExternalDoc> doc;
+  };
+  std::vector<PendingUse> m_pendingUses;
+  size_t m_usesWaited = 0;
+  // image read (and decoded unless lazy) on another thread; attached to node by waitPendingLoads()
+  struct LoadedImage {
+    Image image = Image(0, 0);
+    std::vector<unsigned char> encoded;  // set for lazy image
+  };
+  struct PendingImage {
+    SvgImage* node;
+    std::future<LoadedImage> image;
+  };
+  std::vector<PendingImage> m_pendingLoads;
+  size_t m_loadsWaited = 0;
+
+  std::unique_ptr<XmlStreamReader> m_pushReader;
+  bool m_pushDone = false;
+  bool m_skipPending = false;
+
+  Limits m_limits;
+  bool m_hasLimits = false;
+  size_t m_extDepth = 0;
+  size_t m_nodeCount = 0;
+  size_t m_pathPoints = 0;
+  size_t m_attrBytes = 0;
+  std::atomic<size_t> m_imagePixels{0};  // also updated by AsyncResources loads
+  std::string m_error;
 
   bool m_inStyle = false;
-  std::unique_ptr<SvgCssStylesheet> m_stylesheet;
+  std::string m_styleText;  // contents of all <style> elements, parsed in finishParse()
 
   void parse(XmlStreamReader* const xml);
+  bool parseTokens(XmlStreamReader* const xml);
+  void finishParse(XmlStreamReader* const xml);
+  bool readUnknownNode(XmlStreamReader* const xml);
+  void readLazyGroup(XmlStreamReader* const xml);
+  void parseChildren(const char* src, size_t len, unsigned int opts);
+  static bool patchDocument(SvgDocument* doc, SvgDocument* newdoc);
+  void parsePendingPaths();
+  void waitPendingLoads();
+  bool limitExceeded(const char* what, size_t limit);
+  bool checkElementLimits();
+  bool addPathPoints(size_t npoints);
+  bool reserveImagePixels(const unsigned char* data, size_t len);
+  static ExternalDoc loadExternalDoc(const char* filename, unsigned int flags, const OpenStreamFn& openfn,
+      uint64_t streamid, const Limits& limits, size_t depth);
   const char* useAttribute(const char* name);
+  void indexAttributes();
   bool startElement(StringRef localName, const XmlStreamAttributes& attributes);
   bool endElement(StringRef localName);
   bool cdata(const char* str);
@@ -106,5 +279,6 @@ inline real strToReal(const char* p, char** endptr) { return strToReal<real>(p,
 real toReal(const StringRef& str, real dflt = NaN, int* advance = NULL);
 std::vector<real>& parseNumbersList(StringRef& str, std::vector<real>& points);
 std::vector<real> parseNumbersList(const StringRef& str, size_t reserve);
+bool parsePathData(const StringRef& dataStr, Path2D& path, std::vector<real>& points);
 SvgLength parseLength(const StringRef& str, const SvgLength& dflt = SvgLength());
 Color parseColor(StringRef str, const Color& dflt = Color::INVALID_COLOR);
@@ -1,3 +1,5 @@
+#include <mutex>
+#include <unordered_map>
 #include "svgstyleparser.h"
 #include "svgparser.h"
 
@@ -30,6 +32,7 @@ static real parseFontSize(const char* value)
 {
   static constexpr SvgEnumVal fontSize[] = {{"xx-small", 0}, {"x-small", 1},
     {"small", 2}, {"medium", 3}, {"large", 4}, {"x-large", 4}, {"xx-large", 5}};
+  static constexpr auto fontSizeMap = makeKeywordMap(fontSize);
   static const real sizeTable[] = { 6.9, 8.3, 10.0, 12.0, 14.4, 17.3, 20.7 };
 
   // to support relative sizes, we should store font-size w/ units!
@@ -37,7 +40,7 @@ static real parseFontSize(const char* value)
   if(!std::isnan(size.value))
     return size.px();
 
-  int idx = parseEnum(value, fontSize);
+  int idx = parseEnum(value, fontSizeMap);
   return idx >= 0 ? sizeTable[idx] : 0;
 }
 
@@ -47,13 +50,13 @@ static SvgAttr processStdAttribute(SvgAttr::StdAttr stdattr, const char* value)
   case SvgAttr::COLOR:
     return SvgAttr("color", parseColor(value).color);
   case SvgAttr::COMP_OP:
-    return SvgAttr("comp-op", parseEnum(value, SvgStyle::compOp));
+    return SvgAttr("comp-op", parseEnum(value, SvgStyle::compOpMap));
   case SvgAttr::DISPLAY:
     return SvgAttr("display", StringRef(value) == "none" ? SvgNode::NoneMode : SvgNode::BlockMode);
   case SvgAttr::FILL:
     return parsePaint("fill", value);
   case SvgAttr::FILL_RULE:
-    return SvgAttr("fill-rule", parseEnum(value, SvgStyle::fillRule));
+    return SvgAttr("fill-rule", parseEnum(value, SvgStyle::fillRuleMap));
   case SvgAttr::FILL_OPACITY:
     return SvgAttr("fill-opacity", clamp(toReal(value, 1), 0.0, 1.0));
   case SvgAttr::FONT_FAMILY:
@@ -63,16 +66,16 @@ static SvgAttr processStdAttribute(SvgAttr::StdAttr stdattr, const char* value)
   case SvgAttr::FONT_SIZE:
     return SvgAttr("font-size", parseFontSize(value));
   case SvgAttr::FONT_STYLE:
-    return SvgAttr("font-style", parseEnum(value, SvgStyle::fontStyle));
+    return SvgAttr("font-style", parseEnum(value, SvgStyle::fontStyleMap));
   case SvgAttr::FONT_VARIANT:
-    return SvgAttr("font-variant", parseEnum(value, SvgStyle::fontVariant));
+    return SvgAttr("font-variant", parseEnum(value, SvgStyle::fontVariantMap));
   case SvgAttr::FONT_WEIGHT:
   {
     real weightNum = toReal(value, NaN);
     if(!std::isnan(weightNum))
       return SvgAttr("font-weight", int(weightNum));
     else
-      return SvgAttr("font-weight", parseEnum(value, SvgStyle::fontWeight));
+      return SvgAttr("font-weight", parseEnum(value, SvgStyle::fontWeightMap));
   }
   case SvgAttr::OFFSET:
   {
@@ -83,7 +86,7 @@ static SvgAttr processStdAttribute(SvgAttr::StdAttr stdattr, const char* value)
   case SvgAttr::OPACITY:
     return SvgAttr("opacity", clamp(toReal(value, 1), 0.0, 1.0));
   case SvgAttr::SHAPE_RENDERING:
-    return SvgAttr("shape-rendering", parseEnum(value, SvgStyle::shapeRendering, SvgStyle::Antialias));
+    return SvgAttr("shape-rendering", parseEnum(value, SvgStyle::shapeRenderingMap, SvgStyle::Antialias));
   case SvgAttr::STOP_COLOR:
     return parsePaint("stop-color", value);  // this will incorrectly accept URLs
   case SvgAttr::STOP_OPACITY:
@@ -100,11 +103,11 @@ static SvgAttr processStdAttribute(SvgAttr::StdAttr stdattr, const char* value)
   case SvgAttr::STROKE_DASHOFFSET:
     return SvgAttr("stroke-dashoffset", toReal(value, 0));
   case SvgAttr::STROKE_LINECAP:
-    return SvgAttr("stroke-linecap", parseEnum(value, SvgStyle::lineCap));
+    return SvgAttr("stroke-linecap", parseEnum(value, SvgStyle::lineCapMap));
   case SvgAttr::STROKE_LINEJOIN:
-    return SvgAttr("stroke-linejoin", parseEnum(value, SvgStyle::lineJoin));
+    return SvgAttr("stroke-linejoin", parseEnum(value, SvgStyle::lineJoinMap));
   case SvgAttr::STROKE_ALIGNMENT:
-    return SvgAttr("stroke-alignment", parseEnum(value, SvgStyle::strokeAlign));
+    return SvgAttr("stroke-alignment", parseEnum(value, SvgStyle::strokeAlignMap));
   case SvgAttr::STROKE_MITERLIMIT:
     return SvgAttr("stroke-miterlimit", toReal(value, 0));
   case SvgAttr::STROKE_OPACITY:
@@ -112,11 +115,11 @@ static SvgAttr processStdAttribute(SvgAttr::StdAttr stdattr, const char* value)
   case SvgAttr::STROKE_WIDTH:
     return SvgAttr("stroke-width", toReal(value, 0));
   case SvgAttr::TEXT_ANCHOR:
-    return SvgAttr("text-anchor", parseEnum(value, SvgStyle::textAnchor));
+    return SvgAttr("text-anchor", parseEnum(value, SvgStyle::textAnchorMap));
   case SvgAttr::VECTOR_EFFECT:
-    return SvgAttr("vector-effect", parseEnum(value, SvgStyle::vectorEffect));
+    return SvgAttr("vector-effect", parseEnum(value, SvgStyle::vectorEffectMap));
   case SvgAttr::VISIBILITY:
-    return SvgAttr("visibility", parseEnum(value, SvgStyle::visibility, 1));
+    return SvgAttr("visibility", parseEnum(value, SvgStyle::visibilityMap, 1));
   case SvgAttr::LETTER_SPACING:
     return SvgAttr("letter-spacing", toReal(value, 0));
   default:
@@ -148,18 +151,33 @@ void processStyleString(SvgNode* node, const char* style)
 {
   if(!style || !style[0])
     return;
-  // style string is easy to parse - we don't need CSS parser!
-  std::vector<StringRef> cssAttrs = splitStringRef(style, ';', true);
-  node->attrs.reserve(node->attrs.size() + cssAttrs.size());
-  for(const StringRef& attr : cssAttrs) {
-    std::vector<StringRef> name_val = splitStringRef(attr, ':', false);
-    // this could be done much more efficiently - use splitStrInPlace then just strchr for ':'
-    // ... we'd also need trimInPlace
-    if(name_val.size() == 2)
-      processAttribute(node, SvgAttr::InlineStyleSrc,
-          name_val[0].trimmed().toString().c_str(), name_val[1].trimmed().toString().c_str());
-    else if(!attr.trimmed().isEmpty())
-      PLATFORM_LOG("Invalid CSS in style attribute\n");
+  // style string is easy to parse - we don't need CSS parser!  Name and value are copied to a stack buffer
+  //  to null terminate them, so no heap allocation unless a declaration is very long
+  char buff[256];
+  std::string bigbuff;
+  StringRef rest(style);
+  while(!rest.isEmpty()) {
+    const char* semi = (const char*)memchr(rest.data(), ';', rest.size());
+    StringRef attr(rest.data(), semi ? semi - rest.data() : rest.size());
+    rest = semi ? StringRef(semi + 1, rest.end() - semi - 1) : StringRef();
+    const char* colon = (const char*)memchr(attr.data(), ':', attr.size());
+    if(!colon || memchr(colon + 1, ':', attr.end() - colon - 1)) {
+      if(!attr.trimmed().isEmpty())
+        PLATFORM_LOG("Invalid CSS in style attribute\n");
+      continue;
+    }
+    StringRef name = StringRef(attr.data(), colon - attr.data()).trimmed();
+    StringRef value = StringRef(colon + 1, attr.end() - colon - 1).trimmed();
+    char* dest = buff;
+    if(name.size() + value.size() + 2 > sizeof(buff)) {
+      bigbuff.resize(name.size() + value.size() + 2);
+      dest = &bigbuff[0];
+    }
+    memcpy(dest, name.data(), name.size());
+    dest[name.size()] = '\0';
+    memcpy(dest + name.size() + 1, value.data(), value.size());
+    dest[name.size() + 1 + value.size()] = '\0';
+    processAttribute(node, SvgAttr::InlineStyleSrc, dest, dest + name.size() + 1);
   }
 }
 
@@ -193,6 +211,44 @@ void SvgCssDecls::parseDecl(const char* name, const char* value)
 
 css_declarations* SvgCssStylesheet::createCssDecls() { return new SvgCssDecls; }
 
+// process-wide cache of compiled stylesheets; entries don't keep stylesheets alive, so a stylesheet is freed
+//  when the last document using it is deleted and the expired entry is dropped on a later insertion
+std::shared_ptr<const SvgCssStylesheet> SvgCssStylesheet::fromText(const std::string& css)
+{
+  static std::mutex cacheMutex;
+  static std::unordered_map< std::string, std::weak_ptr<const SvgCssStylesheet> > cache;
+  static size_t nextPurge = 64;
+
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto it = cache.find(css);
+    if(it != cache.end()) {
+      auto stylesheet = it->second.lock();
+      if(stylesheet)
+        return stylesheet;
+    }
+  }
+  // parse outside lock so parallel parsing of different stylesheets isn't serialized
+  auto stylesheet = std::make_shared<SvgCssStylesheet>();
+  stylesheet->parse_stylesheet(css.c_str());
+  if(stylesheet->rules().empty())
+    return NULL;
+  stylesheet->sort_rules();
+
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  std::weak_ptr<const SvgCssStylesheet>& entry = cache[css];
+  auto existing = entry.lock();
+  if(existing)
+    return existing;  // another thread parsed the same text first
+  entry = stylesheet;
+  if(cache.size() >= nextPurge) {
+    for(auto it = cache.begin(); it != cache.end();)
+      it = it->second.expired() ? cache.erase(it) : ++it;
+    nextPurge = std::max(size_t(64), 2*cache.size());
+  }
+  return stylesheet;
+}
+
 void SvgCssStylesheet::applyStyle(SvgNode* node) const
 {
   std::vector<SvgAttr> varAttrs;
@@ -200,12 +256,14 @@ void SvgCssStylesheet::applyStyle(SvgNode* node) const
     if(rule.select(node)) {
       for(const SvgAttr& attr : ((const SvgCssDecls*)rule.decls())->attrs) {
         if(attr.getFlags() & SvgAttr::Variable) {
-          SvgAttr* curr = const_cast<SvgAttr*>(node->getAttr(attr.name(), SvgAttr::CSSSrc));
+          const SvgAttr* curr = node->getAttr(attr.name(), SvgAttr::CSSSrc);
           if(!curr || curr->isStale())
             varAttrs.push_back(attr);
           // prevent replacement by a lower priority value
-          if(curr)
-            curr->setStale(false);
+          if(curr) {
+            if(curr->isStale())
+              node->mutableAttr(curr)->setStale(false);
+          }
           else
             node->setAttr(attr);
         }
@@ -219,9 +277,9 @@ void SvgCssStylesheet::applyStyle(SvgNode* node) const
   //  (previous behavior) to prevent unnecessary dirtying of node
   for(const SvgAttr& attr : varAttrs) {
     // allow replacement (or force removal if unresolved)
-    SvgAttr* curr = const_cast<SvgAttr*>(node->getAttr(attr.name(), SvgAttr::CSSSrc));
-    if(curr)
-      curr->setStale(true);
+    const SvgAttr* curr = node->getAttr(attr.name(), SvgAttr::CSSSrc);
+    if(curr && !curr->isStale())
+      node->mutableAttr(curr)->setStale(true);
     // find closest ancestor with the variable set
     for(SvgNode* n = node; n; n = n->parent()) {
       const SvgAttr* valattr = n->getAttr(attr.stringVal(), SvgAttr::CSSSrc);
@@ -12,6 +12,10 @@ class SvgCssStylesheet : public css_stylesheet
 public:
   css_declarations* createCssDecls() override;
   void applyStyle(SvgNode* node) const;
+
+  // returns parsed and sorted stylesheet for CSS text, shared (so const) with any other live document using the
+  //  same text; returns NULL if text contains no rules
+  static std::shared_ptr<const SvgCssStylesheet> fromText(const std::string& css);
 };
 #endif
 
@@ -21,6 +25,75 @@ bool processAttribute(SvgNode* node, SvgAttr::Src src, const char* name, const c
 
 struct SvgEnumVal { const char* str; int val; };
 
+// FNV-1a hash, usable at compile time; nocase folds ASCII upper case to lower case
+constexpr unsigned int svgHash(const char* s, size_t len, bool nocase = false)
+{
+  unsigned int h = 2166136261u;
+  for(size_t ii = 0; ii < len; ++ii) {
+    unsigned char c = s[ii];
+    if(nocase && c >= 'A' && c <= 'Z')
+      c += 'a' - 'A';
+    h = (h ^ c) * 16777619u;
+  }
+  return h;
+}
+
+constexpr size_t svgStrLen(const char* s) { size_t n = 0;  while(s[n]) ++n;  return n; }
+constexpr unsigned int svgHash(const char* s) { return svgHash(s, svgStrLen(s)); }
+
+// open addressing hash table of keywords built at compile time from SvgEnumVal array, e.g.
+//  static constexpr auto map = makeKeywordMap(enumvals);  Keys must be lower case for findNoCase()
+template<size_t N>
+class SvgKeywordMap
+{
+public:
+  constexpr SvgKeywordMap(const SvgEnumVal (&enumvals)[N]) : slots{}
+  {
+    for(const SvgEnumVal& enumval : enumvals) {
+      unsigned int h = svgHash(enumval.str);
+      size_t ii = h & MASK;
+      while(slots[ii].str)
+        ii = (ii + 1) & MASK;
+      slots[ii].str = enumval.str;
+      slots[ii].len = svgStrLen(enumval.str);
+      slots[ii].val = enumval.val;
+      slots[ii].hash = h;
+    }
+  }
+
+  int find(const StringRef& key, int dflt = INT_MIN) const
+  {
+    unsigned int h = svgHash(key.data(), key.size());
+    for(size_t ii = h & MASK; slots[ii].str; ii = (ii + 1) & MASK) {
+      const Slot& s = slots[ii];
+      if(s.hash == h && s.len == key.size() && memcmp(s.str, key.data(), s.len) == 0)
+        return s.val;
+    }
+    return dflt;
+  }
+
+  int findNoCase(const StringRef& key, int dflt = INT_MIN) const
+  {
+    unsigned int h = svgHash(key.data(), key.size(), true);
+    for(size_t ii = h & MASK; slots[ii].str; ii = (ii + 1) & MASK) {
+      const Slot& s = slots[ii];
+      if(s.hash == h && s.len == key.size() && strncasecmp(s.str, key.data(), s.len) == 0)
+        return s.val;
+    }
+    return dflt;
+  }
+
+private:
+  static constexpr size_t tableSize(size_t n) { size_t size = 4;  while(size < 2*n) size *= 2;  return size; }
+  static constexpr size_t MASK = tableSize(N) - 1;
+
+  struct Slot { const char* str; size_t len; int val; unsigned int hash; };
+  Slot slots[MASK + 1];
+};
+
+template<size_t N>
+constexpr SvgKeywordMap<N> makeKeywordMap(const SvgEnumVal (&enumvals)[N]) { return SvgKeywordMap<N>(enumvals); }
+
 template<int N>
 int parseEnum(const StringRef& value, const SvgEnumVal (&enumvals)[N], int dflt = INT_MIN)
 {
@@ -31,6 +104,12 @@ int parseEnum(const StringRef& value, const SvgEnumVal (&enumvals)[N], int dflt
   return dflt;
 }
 
+template<size_t N>
+int parseEnum(const StringRef& value, const SvgKeywordMap<N>& enummap, int dflt = INT_MIN)
+{
+  return enummap.find(value, dflt);
+}
+
 template<int N>
 const char* enumToStr(int value, const SvgEnumVal (& enumvals)[N])
 {
@@ -94,4 +173,18 @@ namespace SvgStyle
       {"soft-light", Painter::CompOp_SoftLight},
       {"difference", Painter::CompOp_Difference},
       {"exclusion", Painter::CompOp_Exclusion}};
+
+  // hashed lookup tables for parseEnum; arrays above are used for enumToStr
+  static constexpr auto fillRuleMap = makeKeywordMap(fillRule);
+  static constexpr auto vectorEffectMap = makeKeywordMap(vectorEffect);
+  static constexpr auto fontStyleMap = makeKeywordMap(fontStyle);
+  static constexpr auto fontWeightMap = makeKeywordMap(fontWeight);
+  static constexpr auto fontVariantMap = makeKeywordMap(fontVariant);
+  static constexpr auto lineCapMap = makeKeywordMap(lineCap);
+  static constexpr auto lineJoinMap = makeKeywordMap(lineJoin);
+  static constexpr auto strokeAlignMap = makeKeywordMap(strokeAlign);
+  static constexpr auto textAnchorMap = makeKeywordMap(textAnchor);
+  static constexpr auto shapeRenderingMap = makeKeywordMap(shapeRendering);
+  static constexpr auto visibilityMap = makeKeywordMap(visibility);
+  static constexpr auto compOpMap = makeKeywordMap(compOp);
 };
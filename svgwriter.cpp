@@ -174,9 +174,9 @@ void SvgWriter::serialize(SvgNode* node)
 void SvgWriter::serializeNodeAttr(SvgNode* node)
 {
   if(!node->m_id.empty())
-    xml.writeAttribute("id", node->m_id);
+    xml.writeAttribute("id", node->xmlId());
   if(!node->m_class.empty())
-    xml.writeAttribute("class", node->m_class);
+    xml.writeAttribute("class", node->xmlClass());
   if(node->hasTransform()) {
     char* buff = serializeTransform(xml.getTemp(), node->getTransform());
     const char* tfname = "transform";
@@ -187,7 +187,7 @@ void SvgWriter::serializeNodeAttr(SvgNode* node)
   }
 
   // extension can write attributes directly (preferred) or update node attrs before they're written
-  if(node->hasExt())
+  if(node->hasExt() && serializeExt)
     node->ext()->serializeAttr(this);
 
   auto it = node->attrs.begin();
@@ -288,6 +288,16 @@ void SvgWriter::_serialize(SvgGradient* node)
   xml.writeEndElement();
 }
 
+void SvgWriter::writeDataUri(const char* mime, const unsigned char* data, size_t len)
+{
+  size_t prefixlen = strlen(mime) + 13;  // "data:" + mime + ";base64,"
+  // encode into writer's reusable temp buffer
+  char* base64 = xml.getTemp(prefixlen + base64EncLen(len) + 1);  // account for \0 terminator
+  snprintf(base64, prefixlen + 1, "data:%s;base64,", mime);
+  base64[prefixlen + base64Encode(data, len, base64 + prefixlen)] = '\0';
+  xml.writeAttribute("xlink:href", base64);
+}
+
 void SvgWriter::_serialize(SvgImage* node)
 {
   Rect m_bounds = node->m_bounds;
@@ -299,13 +309,24 @@ void SvgWriter::_serialize(SvgImage* node)
   if(m_bounds.height() > 0) xml.writeAttribute("height", m_bounds.height());
   //xml.writeAttribute("preserveAspectRatio", "none");
 
-  // m_linkStr will be empty iff image successfully loaded from inline base64
+  // m_linkStr will be empty iff image successfully loaded from inline base64 or is lazy image from data URI
   if(node->m_linkStr.empty()) {
+    const Image& image = *node->image();
+    if((image.width <= 0 || image.height <= 0) && node->m_encoded) {
+      // image couldn't be decoded, so write original bytes back
+      std::lock_guard<std::mutex> lock(node->m_encoded->mutex);
+      const std::vector<unsigned char>& data = node->m_encoded->data;
+      const char* mime = data.size() > 2 && data[0] == 0x89 && data[1] == 'P' ? "image/png" :
+          data.size() > 2 && data[0] == 0xFF && data[1] == 0xD8 ? "image/jpeg" : "application/octet-stream";
+      writeDataUri(mime, data.data(), data.size());
+      xml.writeEndElement();
+      return;
+    }
     Image cropped(0, 0);
-    bool crop = node->srcRect.isValid() && node->srcRect != Rect::wh(node->m_image.width, node->m_image.height);
+    bool crop = node->srcRect.isValid() && node->srcRect != Rect::wh(image.width, image.height);
     if(crop)
-      cropped = node->m_image.cropped(node->srcRect);
-    const Image& img = crop ? cropped : node->m_image;
+      cropped = image.cropped(node->srcRect);
+    const Image& img = crop ? cropped : image;
 
     Transform2D tf = node->totalTransform();
     Rect tf_bounds = tf.mapRect(node->viewport());
@@ -317,15 +338,7 @@ void SvgWriter::_serialize(SvgImage* node)
     // compress image
     Image::Encoding fmt = img.encoding == Image::JPEG && !img.hasTransparency() ? Image::JPEG : Image::PNG;
     auto buff = scaleimg ? img.scaled(scaledw, scaledh).encode(fmt) : img.encode(fmt);
-
-    std::string prefix = std::string("data:image/") + (fmt == Image::JPEG ? "jpeg" : "png") + ";base64,";
-    size_t base64len = base64_enclen(buff.size()) + prefix.size() + 1;  // account for \0 terminator
-    char* base64 = new char[base64len];
-    strcpy(base64, prefix.c_str());
-    base64_encode(buff.data(), buff.size(), base64 + prefix.size());
-    base64[base64len - 1] = '\0';
-    xml.writeAttribute("xlink:href", base64);
-    delete[] base64;
+    writeDataUri(fmt == Image::JPEG ? "image/jpeg" : "image/png", buff.data(), buff.size());
   }
   else
     xml.writeAttribute("xlink:href", node->m_linkStr.c_str());
@@ -407,6 +420,14 @@ static const char* serializePathData(char* buff, const Path2D& m_path, int prec,
 
 void SvgWriter::_serialize(SvgPath* node)
 {
+  // lazy path that was never used - write original path data
+  if(!node->pathData().empty()) {
+    xml.writeStartElement("path");
+    serializeNodeAttr(node);
+    xml.writeAttribute("d", node->pathData().c_str());
+    xml.writeEndElement();
+    return;
+  }
   const Path2D& m_path = node->m_path;
   if(node->m_pathType == SvgNode::LINE) {
     xml.writeStartElement("line");
@@ -587,7 +608,7 @@ void SvgWriter::_serialize(SvgCustomNode* node)
 {
   xml.writeStartElement("foreignObject");
   serializeNodeAttr(node);
-  if(node->hasExt())
+  if(node->hasExt() && serializeExt)
     node->ext()->serialize(this);
   xml.writeEndElement();
 }
@@ -10,6 +10,7 @@ public:
   XmlStreamWriter& xml;
   float saveImageScaled = DEFAULT_SAVE_IMAGE_SCALED;
   bool pathDataRel = DEFAULT_PATH_DATA_REL;
+  bool serializeExt = true;  // write attributes and content from node extensions
   std::vector<SvgNode*> tempNodes;
 
   SvgWriter(XmlStreamWriter& _xml) : xml(_xml) {}
@@ -35,6 +36,7 @@ private:
   void serializeNodeAttr(SvgNode* node);
   void serializeChildren(SvgContainerNode* node);
   void serializeTspan(SvgTspan* node);
+  void writeDataUri(const char* mime, const unsigned char* data, size_t len);
 
   void _serialize(SvgDocument* node);
   void _serialize(SvgG* node);
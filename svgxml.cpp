@@ -0,0 +1,600 @@
+#include <algorithm>
+#include "svgxml.h"
+
+#ifdef _WIN32
+#include "ulib/fileutil.h"  // readFile() for MappedFile
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static bool isXmlSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+static bool isNameEnd(char c) { return isXmlSpace(c) || c == '>' || c == '/' || c == '=' || c == '?'; }
+
+static bool startsWith(const char* p, const char* end, const char* s)
+{
+  size_t n = strlen(s);
+  return size_t(end - p) >= n && memcmp(p, s, n) == 0;
+}
+
+// true if all of [p, end) matches start of s, but s is longer
+static bool isPartialPrefix(const char* p, const char* end, const char* s)
+{
+  size_t n = end - p;
+  return n < strlen(s) && memcmp(p, s, n) == 0;
+}
+
+static const char* findStr(const char* p, const char* end, const char* s)
+{
+  size_t n = strlen(s);
+  while(size_t(end - p) >= n) {
+    p = (const char*)memchr(p, s[0], end - p - n + 1);
+    if(!p)
+      return NULL;
+    if(memcmp(p, s, n) == 0)
+      return p;
+    ++p;
+  }
+  return NULL;
+}
+
+XmlPullParser::XmlPullParser(const char* data, size_t len, unsigned int opts)
+    : src(data), pos(data), end(data + len), flags(opts)
+{
+  if(flags & XmlStreamReader::PushParse) {
+    final = false;
+    src = pos = end = NULL;
+    append(data, len);
+  }
+  else if(startsWith(pos, end, "\xEF\xBB\xBF"))  // skip UTF-8 BOM
+    pos += 3;
+  scratch.reserve(1024);
+  tagNames.reserve(256);
+  openTags.reserve(32);
+}
+
+void XmlPullParser::append(const char* data, size_t len)
+{
+  if(final || !data || !len)
+    return;
+  // source before current token (or current fragment or text-only element) is no longer needed
+  size_t keep = std::min(tokenStart, fragStart);
+  if(!openTags.empty() && openTags.back().leaf)
+    keep = std::min(keep, openTags.back().srcOffset);
+  if(keep >= MIN_PUSH_DISCARD && keep >= pushBuff.size()/2)
+    discardSource(keep);
+  size_t offset = pos - src;
+  pushBuff.insert(pushBuff.end(), data, data + len);
+  src = pushBuff.data();
+  pos = src + offset;
+  end = src + pushBuff.size();
+  // skip UTF-8 BOM, which may be split across chunks (nothing is consumed until a '<' is received)
+  if(!bomChecked && !isPartialPrefix(pos, end, "\xEF\xBB\xBF")) {
+    if(startsWith(pos, end, "\xEF\xBB\xBF"))
+      pos += 3;
+    bomChecked = true;
+  }
+}
+
+// remove first n bytes of pushBuff and adjust offsets; open elements starting before n lose their source
+void XmlPullParser::discardSource(size_t n)
+{
+  size_t offset = pos - src;
+  pushBuff.erase(pushBuff.begin(), pushBuff.begin() + n);
+  src = pushBuff.data();
+  pos = src + (offset - n);
+  end = src + pushBuff.size();
+  tokenStart -= n;
+  scanPos -= std::min(scanPos, n);
+  if(fragStart != NPOS)
+    fragStart -= n;
+  for(OpenTag& tag : openTags)
+    tag.srcOffset -= std::min(tag.srcOffset, n);
+}
+
+// in push mode, check that token starting at pos has been completely received
+bool XmlPullParser::tokenComplete()
+{
+  if(final)
+    return true;
+  size_t tokpos = pos - src;
+  if(scanPos < tokpos) {
+    scanPos = tokpos;
+    scanQuote = 0;
+  }
+  const char* p = src + scanPos;
+  const char* found = NULL;
+  if(*pos != '<')
+    found = (const char*)memchr(p, '<', end - p);
+  else if(isPartialPrefix(pos, end, "<!--") || isPartialPrefix(pos, end, "<![CDATA["))
+    return false;  // can't tell what kind of markup this is yet
+  else if(startsWith(pos, end, "<!--") || startsWith(pos, end, "<![CDATA[") || (end - pos > 1 && pos[1] == '?')) {
+    const char* term = pos[1] == '?' ? "?>" : pos[2] == '-' ? "-->" : "]]>";
+    // resume search, allowing for terminator split across chunks
+    size_t termlen = strlen(term);
+    const char* from = std::max(pos + 2, p - std::min(size_t(p - pos), termlen - 1));
+    found = findStr(from, end, term);
+  }
+  else {
+    // start tag, end tag, or doctype - find '>' outside quotes
+    for(; p < end; ++p) {
+      if(scanQuote) {
+        if(*p == scanQuote)
+          scanQuote = 0;
+      }
+      else if(*p == '"' || *p == '\'')
+        scanQuote = *p;
+      else if(*p == '>') {
+        found = p;
+        break;
+      }
+    }
+    // doctype w/ internal subset ends w/ "]>" (possibly w/ whitespace between)
+    if(found && pos[1] == '!' && memchr(pos, '[', found - pos)) {
+      const char* q = found;
+      while(q > pos && isXmlSpace(q[-1])) --q;
+      if(q[-1] != ']') {
+        scanPos = found + 1 - src;
+        return false;
+      }
+    }
+  }
+  if(found)
+    return true;
+  scanPos = end - src;
+  return false;
+}
+
+const char* XmlPullParser::name() const
+{
+  if(token == XmlStreamReader::StartElement || token == XmlStreamReader::EndElement)
+    return tagNames.c_str() + openTags.back().nameOffset;
+  return nameOffset != NPOS ? &scratch[nameOffset] : "";
+}
+
+int XmlPullParser::readNext()
+{
+  if(popPending) {
+    tagNames.resize(openTags.back().nameOffset);
+    openTags.pop_back();
+    popPending = false;
+  }
+  scratch.clear();
+  attrPtrs.clear();
+  nameOffset = NPOS;
+  textOffset = NPOS;
+
+  if(token == XmlStreamReader::NoToken)
+    return (token = XmlStreamReader::StartDocument);
+  if(token == XmlStreamReader::EndDocument)
+    return token;
+  if(selfClosing) {
+    selfClosing = false;
+    popPending = true;
+    return (token = XmlStreamReader::EndElement);
+  }
+
+  while(pos < end && !parseStatus) {
+    if(!tokenComplete())
+      return (token = XmlStreamReader::NeedMoreData);
+    tokenStart = pos - src;
+    if(*pos != '<') {
+      if(parseText())
+        return (token = XmlStreamReader::CData);
+    }
+    else if(pos + 1 < end && pos[1] == '/') {
+      if(parseEndTag()) {
+        popPending = true;
+        return (token = XmlStreamReader::EndElement);
+      }
+    }
+    else if(pos + 1 < end && (pos[1] == '!' || pos[1] == '?')) {
+      if(parseMarkup())
+        return token;
+    }
+    else if(parseStartTag())
+      return (token = XmlStreamReader::StartElement);
+  }
+  if(!final && !parseStatus)
+    return (token = XmlStreamReader::NeedMoreData);
+  if(!openTags.empty() && !parseStatus)
+    parseStatus = pugi::status_end_element_mismatch;  // unexpected end of input
+  return (token = XmlStreamReader::EndDocument);
+}
+
+// text content up to next '<'; whitespace-only text is skipped (as for pugi) unless parse_ws_pcdata is set
+bool XmlPullParser::parseText()
+{
+  const char* lt = (const char*)memchr(pos, '<', end - pos);
+  const char* s = pos;
+  pos = lt ? lt : end;
+  if(openTags.empty())
+    return false;  // ignore text outside root element
+  if(!(flags & pugi::parse_ws_pcdata)) {
+    const char* p = s;
+    while(p < pos && isXmlSpace(*p)) ++p;
+    if(p == pos)
+      return false;
+  }
+  textOffset = scratch.size();
+  copyText(s, pos, PCDATA_TEXT);
+  return true;
+}
+
+bool XmlPullParser::parseStartTag()
+{
+  const char* p = pos + 1;
+  const char* nameEnd = p;
+  while(nameEnd < end && !isNameEnd(*nameEnd)) ++nameEnd;
+  if(nameEnd == p)
+    return fail(pugi::status_unrecognized_tag);
+  if(!openTags.empty())
+    openTags.back().leaf = false;
+  openTags.push_back({tagNames.size(), size_t(pos - src), true});
+  tagNames.append(p, nameEnd - p).push_back('\0');
+
+  p = nameEnd;
+  attrOffsets.clear();
+  for(;;) {
+    while(p < end && isXmlSpace(*p)) ++p;
+    if(p >= end)
+      return fail(pugi::status_bad_start_element);
+    if(*p == '>') {
+      ++p;
+      break;
+    }
+    if(*p == '/') {
+      if(p + 1 < end && p[1] == '>') {
+        selfClosing = true;
+        p += 2;
+        break;
+      }
+      return fail(pugi::status_bad_start_element);
+    }
+    const char* attrName = p;
+    while(p < end && !isNameEnd(*p)) ++p;
+    if(p == attrName)
+      return fail(pugi::status_bad_attribute);
+    attrOffsets.push_back(scratch.size());
+    scratch.insert(scratch.end(), attrName, p);
+    scratch.push_back('\0');
+    while(p < end && isXmlSpace(*p)) ++p;
+    if(p >= end || *p != '=')
+      return fail(pugi::status_bad_attribute);
+    ++p;
+    while(p < end && isXmlSpace(*p)) ++p;
+    if(p >= end || (*p != '"' && *p != '\''))
+      return fail(pugi::status_bad_attribute);
+    const char* valEnd = (const char*)memchr(p + 1, *p, end - p - 1);
+    if(!valEnd)
+      return fail(pugi::status_bad_attribute);
+    attrOffsets.push_back(scratch.size());
+    copyText(p + 1, valEnd, ATTR_TEXT);
+    p = valEnd + 1;
+  }
+  pos = p;
+  // scratch will not be reallocated again until next token, so now we can create pointers into it
+  for(size_t offset : attrOffsets)
+    attrPtrs.push_back(&scratch[offset]);
+  attrPtrs.push_back(NULL);
+  attrPtrs.push_back(NULL);
+  return true;
+}
+
+bool XmlPullParser::parseEndTag()
+{
+  const char* p = pos + 2;
+  const char* nameEnd = p;
+  while(nameEnd < end && !isNameEnd(*nameEnd)) ++nameEnd;
+  const char* gt = nameEnd;
+  while(gt < end && isXmlSpace(*gt)) ++gt;
+  if(gt >= end || *gt != '>')
+    return fail(pugi::status_bad_end_element);
+  if(openTags.empty())
+    return fail(pugi::status_end_element_mismatch);
+  size_t off = openTags.back().nameOffset;
+  size_t len = tagNames.size() - off - 1;
+  if(len != size_t(nameEnd - p) || memcmp(tagNames.data() + off, p, len) != 0)
+    return fail(pugi::status_end_element_mismatch);
+  pos = gt + 1;
+  return true;
+}
+
+// comments, CDATA, processing instructions, and doctype; returns true if token should be reported
+bool XmlPullParser::parseMarkup()
+{
+  if(startsWith(pos, end, "<!--")) {
+    const char* e = findStr(pos + 4, end, "-->");
+    if(!e)
+      return fail(pugi::status_bad_comment);
+    const char* s = pos + 4;
+    pos = e + 3;
+    if(!(flags & pugi::parse_comments))
+      return false;
+    textOffset = scratch.size();
+    copyText(s, e, RAW_TEXT);
+    token = XmlStreamReader::Comment;
+    return true;
+  }
+  if(startsWith(pos, end, "<![CDATA[")) {
+    const char* e = findStr(pos + 9, end, "]]>");
+    if(!e)
+      return fail(pugi::status_bad_cdata);
+    const char* s = pos + 9;
+    pos = e + 3;
+    if(!(flags & pugi::parse_cdata) || openTags.empty())
+      return false;
+    textOffset = scratch.size();
+    copyText(s, e, RAW_TEXT);
+    token = XmlStreamReader::CData;
+    return true;
+  }
+  if(pos[1] == '?') {
+    const char* e = findStr(pos + 2, end, "?>");
+    if(!e)
+      return fail(pugi::status_bad_pi);
+    const char* target = pos + 2;
+    const char* targetEnd = target;
+    while(targetEnd < e && !isXmlSpace(*targetEnd)) ++targetEnd;
+    pos = e + 2;
+    // <?xml ... ?> declaration is not reported (pugi only reports w/ parse_declaration)
+    if(!(flags & pugi::parse_pi) || (targetEnd - target == 3 && memcmp(target, "xml", 3) == 0))
+      return false;
+    nameOffset = scratch.size();
+    copyText(target, targetEnd, RAW_TEXT);
+    while(targetEnd < e && isXmlSpace(*targetEnd)) ++targetEnd;
+    textOffset = scratch.size();
+    copyText(targetEnd, e, RAW_TEXT);
+    token = XmlStreamReader::ProcessingInstruction;
+    return true;
+  }
+  // <!DOCTYPE ...> - skip, including any internal subset
+  int depth = 0;
+  for(const char* p = pos + 2; p < end; ++p) {
+    if(*p == '"' || *p == '\'') {
+      p = (const char*)memchr(p + 1, *p, end - p - 1);
+      if(!p)
+        break;
+    }
+    else if(*p == '<' || *p == '[')
+      ++depth;
+    else if(*p == ']')
+      --depth;
+    else if(*p == '>' && depth-- <= 0) {
+      pos = p + 1;
+      return false;
+    }
+  }
+  return fail(pugi::status_bad_doctype);
+}
+
+// append text to scratch w/ processing equivalent to pugi parse_eol, parse_escapes, parse_wconv_attribute
+void XmlPullParser::copyText(const char* s, const char* e, TextMode mode)
+{
+  bool eol = flags & pugi::parse_eol;
+  bool escapes = mode != RAW_TEXT && (flags & pugi::parse_escapes);
+  bool wconv = mode == ATTR_TEXT && (flags & pugi::parse_wconv_attribute);
+  while(s < e) {
+    // copy runs of plain chars in bulk
+    const char* run = s;
+    while(s < e && *s != '\r' && *s != '&' && (!wconv || (*s != '\n' && *s != '\t'))) ++s;
+    scratch.insert(scratch.end(), run, s);
+    if(s >= e)
+      break;
+    char c = *s++;
+    if(c == '\r' && eol) {
+      if(s < e && *s == '\n') ++s;
+      c = '\n';
+    }
+    if(c == '&' && escapes)
+      s = decodeEntity(s, e);
+    else
+      scratch.push_back(wconv && isXmlSpace(c) ? ' ' : c);
+  }
+  scratch.push_back('\0');
+}
+
+// s points to char after '&'; decoded char is appended to scratch, or '&' if entity is not recognized
+const char* XmlPullParser::decodeEntity(const char* s, const char* e)
+{
+  const char* semi = (const char*)memchr(s, ';', std::min(e - s, ptrdiff_t(10)));
+  unsigned int cp = 0;
+  if(semi && s[0] == '#') {
+    bool hex = s[1] == 'x';
+    for(const char* p = s + (hex ? 2 : 1); p < semi; ++p) {
+      char c = *p;
+      int d = c >= '0' && c <= '9' ? c - '0' : -1;
+      if(hex && d < 0)
+        d = (c|0x20) >= 'a' && (c|0x20) <= 'f' ? (c|0x20) - 'a' + 10 : -1;
+      if(d < 0) {
+        cp = 0;
+        break;
+      }
+      cp = cp*(hex ? 16 : 10) + d;
+    }
+  }
+  else if(semi) {
+    StringRef ent(s, semi - s);
+    cp = ent == "lt" ? '<' : ent == "gt" ? '>' : ent == "amp" ? '&' : ent == "quot" ? '"' : ent == "apos" ? '\'' : 0;
+  }
+  if(cp == 0 || cp > 0x10FFFF) {
+    scratch.push_back('&');
+    return s;
+  }
+  // encode as UTF-8
+  if(cp < 0x80)
+    scratch.push_back(char(cp));
+  else if(cp < 0x800) {
+    scratch.push_back(char(0xC0 | (cp >> 6)));
+    scratch.push_back(char(0x80 | (cp & 0x3F)));
+  }
+  else if(cp < 0x10000) {
+    scratch.push_back(char(0xE0 | (cp >> 12)));
+    scratch.push_back(char(0x80 | ((cp >> 6) & 0x3F)));
+    scratch.push_back(char(0x80 | (cp & 0x3F)));
+  }
+  else {
+    scratch.push_back(char(0xF0 | (cp >> 18)));
+    scratch.push_back(char(0x80 | ((cp >> 12) & 0x3F)));
+    scratch.push_back(char(0x80 | ((cp >> 6) & 0x3F)));
+    scratch.push_back(char(0x80 | (cp & 0x3F)));
+  }
+  return semi + 1;
+}
+
+bool XmlPullParser::readNodeSource(const char** startOut, const char** endOut)
+{
+  size_t start = tokenStart;
+  if(token == XmlStreamReader::StartElement || fragStart != NPOS) {
+    if(fragStart == NPOS) {
+      fragDepth = openTags.size();
+      fragStart = openTags.back().srcOffset;
+    }
+    while(readNext() != XmlStreamReader::EndDocument) {
+      if(token == XmlStreamReader::NeedMoreData)
+        return false;
+      if(token == XmlStreamReader::EndElement && openTags.size() == fragDepth)
+        break;
+    }
+    start = fragStart;
+    fragStart = NPOS;
+  }
+  else if(token == XmlStreamReader::EndElement)
+    start = openTags.back().srcOffset;
+  else if(token != XmlStreamReader::CData && token != XmlStreamReader::Comment
+      && token != XmlStreamReader::ProcessingInstruction)
+    start = pos - src;  // empty
+  *startOut = src + start;
+  *endOut = pos;
+  return true;
+}
+
+// XmlFragment
+
+StringRef XmlFragment::name() const
+{
+  const char* p = data();
+  const char* end = p + size();
+  if(p == end || *p != '<' || ++p == end || *p == '!' || *p == '?')
+    return StringRef(p, 0);
+  const char* name = p;
+  while(p != end && !isNameEnd(*p)) ++p;
+  return StringRef(name, p - name);
+}
+
+// base64 codec
+// 8 chars <-> 6 bytes per iteration in a 64-bit register; decoder falls back to one char at a time for whitespace,
+//  padding, and the tail
+
+static const char base64Chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+struct Base64DecodeTable
+{
+  unsigned char t[256];
+  Base64DecodeTable()
+  {
+    memset(t, 0x80, sizeof(t));
+    for(int ii = 0; ii < 64; ++ii)
+      t[(unsigned char)base64Chars[ii]] = ii;
+    t['-'] = 62;  t['_'] = 63;  // base64url
+  }
+};
+
+size_t base64Encode(const unsigned char* src, size_t len, char* dst)
+{
+  char* d = dst;
+  const unsigned char* end = src + len;
+  while(end - src >= 6) {
+    uint64_t v = uint64_t(src[0]) << 40 | uint64_t(src[1]) << 32 | uint64_t(src[2]) << 24
+        | uint64_t(src[3]) << 16 | uint64_t(src[4]) << 8 | uint64_t(src[5]);
+    d[0] = base64Chars[(v >> 42) & 0x3F];  d[1] = base64Chars[(v >> 36) & 0x3F];
+    d[2] = base64Chars[(v >> 30) & 0x3F];  d[3] = base64Chars[(v >> 24) & 0x3F];
+    d[4] = base64Chars[(v >> 18) & 0x3F];  d[5] = base64Chars[(v >> 12) & 0x3F];
+    d[6] = base64Chars[(v >> 6) & 0x3F];  d[7] = base64Chars[v & 0x3F];
+    src += 6;  d += 8;
+  }
+  while(src < end) {
+    size_t n = std::min(size_t(end - src), size_t(3));
+    unsigned int v = unsigned(src[0]) << 16 | (n > 1 ? unsigned(src[1]) << 8 : 0) | (n > 2 ? src[2] : 0);
+    d[0] = base64Chars[(v >> 18) & 0x3F];
+    d[1] = base64Chars[(v >> 12) & 0x3F];
+    d[2] = n > 1 ? base64Chars[(v >> 6) & 0x3F] : '=';
+    d[3] = n > 2 ? base64Chars[v & 0x3F] : '=';
+    src += n;  d += 4;
+  }
+  return d - dst;
+}
+
+size_t base64Decode(const char* src, size_t len, unsigned char* dst)
+{
+  static const Base64DecodeTable table;
+  const unsigned char* s = (const unsigned char*)src;
+  const unsigned char* end = s + len;
+  const unsigned char* t = table.t;
+  unsigned char* d = dst;
+  unsigned int bits = 0;
+  int nbits = 0;
+  while(s < end) {
+    // fast path: 8 valid chars w/ no partial group pending
+    if(nbits == 0 && end - s >= 8) {
+      unsigned int c0 = t[s[0]], c1 = t[s[1]], c2 = t[s[2]], c3 = t[s[3]];
+      unsigned int c4 = t[s[4]], c5 = t[s[5]], c6 = t[s[6]], c7 = t[s[7]];
+      if(!((c0 | c1 | c2 | c3 | c4 | c5 | c6 | c7) & 0x80)) {
+        uint64_t v = uint64_t(c0) << 42 | uint64_t(c1) << 36 | uint64_t(c2) << 30 | uint64_t(c3) << 24
+            | uint64_t(c4) << 18 | uint64_t(c5) << 12 | uint64_t(c6) << 6 | uint64_t(c7);
+        d[0] = v >> 40;  d[1] = v >> 32;  d[2] = v >> 24;  d[3] = v >> 16;  d[4] = v >> 8;  d[5] = v;
+        s += 8;  d += 6;
+        continue;
+      }
+    }
+    unsigned int c = t[*s];
+    if(c & 0x80) {
+      if(isXmlSpace(*s)) { ++s;  continue; }
+      break;  // '=' or invalid
+    }
+    bits = (bits << 6) | c;
+    nbits += 6;
+    if(nbits >= 8) {
+      nbits -= 8;
+      *d++ = (bits >> nbits) & 0xFF;
+    }
+    ++s;
+  }
+  return d - dst;
+}
+
+// MappedFile
+
+#ifdef _WIN32
+MappedFile::MappedFile(const char* filename)
+{
+  if(readFile(&buff, filename) && !buff.empty()) {
+    data = &buff[0];
+    size = buff.size();
+  }
+}
+
+MappedFile::~MappedFile() {}
+#else
+MappedFile::MappedFile(const char* filename)
+{
+  int fd = open(filename, O_RDONLY);
+  if(fd < 0)
+    return;
+  struct stat st;
+  if(fstat(fd, &st) == 0 && st.st_size > 0) {
+    void* p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if(p != MAP_FAILED) {
+      madvise(p, st.st_size, MADV_SEQUENTIAL);
+      data = (char*)p;
+      size = st.st_size;
+    }
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() { if(data) munmap(data, size); }
+#endif
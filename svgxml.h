@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <memory>
+#include <iterator>
 
 #include "pugixml.hpp"
 // don't want to fork pugi repo on account of two lines!
@@ -20,16 +21,63 @@ struct PugiXMLWriter : public pugi::xml_writer
   void write(const void* data, size_t size) override { strm.write(data, size); }
 };
 
+struct PugiStringWriter : public pugi::xml_writer
+{
+  std::string& str;
+  PugiStringWriter(std::string& _str) : str(_str) {}
+  void write(const void* data, size_t size) override { str.append((const char*)data, size); }
+};
+
+// private (copy-on-write) mapping of file so that it can be parsed in place w/o copying through a stream
+struct MappedFile
+{
+  char* data = NULL;
+  size_t size = 0;
+#ifdef _WIN32
+  std::string buff;
+#endif
+  MappedFile(const char* filename);
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+};
+
+// source text of an unrecognized node (element, comment, or processing instruction) preserved for writing;
+//  fragments read by the same XmlStreamReader share buffers (instead of each holding a pugi document)
 class XmlFragment
 {
 public:
-  pugi::xml_document doc;
-  XmlFragment(const pugi::xml_node& node) { doc.append_copy(node); }
-  XmlFragment* clone() const { return new XmlFragment(doc.first_child()); }
-  const char* name() const { return doc.first_child().name(); }
+  static constexpr unsigned int parseOpts = pugi::parse_default | pugi::parse_comments | pugi::parse_pi;
+  // a new shared buffer is started once this size is reached, so one surviving fragment can't keep source of
+  //  every other fragment in document alive
+  static constexpr size_t MAX_SHARED_STORE = 1 << 16;
+
+  XmlFragment() : len(0) {}
+  XmlFragment(std::shared_ptr<const std::string> _store, size_t _offset, size_t _len)
+      : store(std::move(_store)), offset(_offset), len(_len) {}
+  XmlFragment(const char* data, size_t _len) : store(std::make_shared<std::string>(data, _len)), len(_len) {}
+  XmlFragment* clone() const { return new XmlFragment(*this); }
+
+  const char* data() const { return store ? store->data() + offset : ""; }
+  size_t size() const { return len; }
+  // element name (pointing into source); empty for comment or PI
+  StringRef name() const;
+  // parse source, e.g., to access content
+  bool load(pugi::xml_document& doc) const { return doc.load_buffer(data(), size(), parseOpts); }
+
+private:
+  std::shared_ptr<const std::string> store;
+  size_t offset = 0;
+  size_t len;
 };
 
 // TODO: remove "write" prefix from each method
+// base64 codec for data URIs - dst must have room for base64EncLen(len) or base64MaxDecLen(len) bytes; encoder
+//  does not write null terminator; decoder skips whitespace, stops at '=' or invalid char, returns bytes written
+size_t base64Encode(const unsigned char* src, size_t len, char* dst);
+size_t base64Decode(const char* src, size_t len, unsigned char* dst);
+inline size_t base64EncLen(size_t len) { return 4*((len + 2)/3); }
+inline size_t base64MaxDecLen(size_t len) { return 3*((len + 3)/4); }
+
 class XmlStreamWriter
 {
   pugi::xml_document doc;
@@ -90,7 +138,7 @@ public:
 
   XmlStreamWriter& writeFragment(const XmlFragment& fragment)
   {
-    node.append_copy(fragment.doc.first_child());
+    node.append_buffer(fragment.data(), fragment.size(), XmlFragment::parseOpts);
     return *this;
   }
 
@@ -121,17 +169,30 @@ public:
     PugiXMLWriter writer(strm);
     doc.save(writer, indent, pugi::format_default | pugi::format_no_declaration);
   }
+
+  std::string toString() const
+  {
+    std::string str;
+    PugiStringWriter writer(str);
+    doc.save(writer, "", pugi::format_raw | pugi::format_no_declaration);
+    return str;
+  }
 };
 
 class XmlStreamAttribute
 {
   pugi::xml_attribute attr;
+  const char* const* pullAttr = NULL;  // name, value pairs from XmlPullParser, terminated by NULL name
 public:
   XmlStreamAttribute(pugi::xml_attribute _attr) : attr(_attr) {}
-  const char* name() const { return attr.name(); }
-  const char* value() const { return attr.as_string(); }
-  XmlStreamAttribute next() const { return XmlStreamAttribute(attr.next_attribute()); }
-  operator bool() { return attr; }
+  XmlStreamAttribute(const char* const* _pullAttr) : pullAttr(_pullAttr) {}
+  const char* name() const { return pullAttr ? pullAttr[0] : attr.name(); }
+  const char* value() const { return pullAttr ? pullAttr[1] : attr.as_string(); }
+  XmlStreamAttribute next() const
+  {
+    return pullAttr ? XmlStreamAttribute(pullAttr + 2) : XmlStreamAttribute(attr.next_attribute());
+  }
+  operator bool() { return pullAttr ? pullAttr[0] != NULL : bool(attr); }
 };
 
 // TODO: consider requiring that caller manage 'doc' instead of us!
@@ -140,14 +201,98 @@ class XmlStreamAttributes
 protected:
   pugi::xml_node node;
   std::unique_ptr<pugi::xml_document> doc;
+  const char* const* pullAttrs = NULL;
 public:
   XmlStreamAttributes(pugi::xml_node _node) : node(_node), doc(nullptr) {}
+  XmlStreamAttributes(const char* const* _pullAttrs) : doc(nullptr), pullAttrs(_pullAttrs) {}
   XmlStreamAttributes() : doc(new pugi::xml_document()) { node = doc->append_child("dummy"); }
   XmlStreamAttributes(XmlStreamAttributes&&) = default;
 
-  const char* value(const char* name) const { return node.attribute(name).as_string(); }
+  const char* value(const char* name) const
+  {
+    if(!pullAttrs)
+      return node.attribute(name).as_string();
+    for(const char* const* a = pullAttrs; *a; a += 2) {
+      if(strcmp(a[0], name) == 0)
+        return a[1];
+    }
+    return "";
+  }
   void append(const char* name, const char* value) { node.append_attribute(name).set_value(value); }
-  XmlStreamAttribute firstAttribute() const { return XmlStreamAttribute(node.first_attribute()); }
+  XmlStreamAttribute firstAttribute() const
+  {
+    return pullAttrs ? XmlStreamAttribute(pullAttrs) : XmlStreamAttribute(node.first_attribute());
+  }
+};
+
+// Minimal non-validating XML tokenizer used for XmlStreamReader::PullParse - tokens are read directly from the
+//  source buffer instead of building a pugi DOM for the whole document.  Names, attribute values, and text are
+//  copied (w/ entities decoded) into a scratch buffer reused for every token, so source is never modified but
+//  must remain valid until parsing is finished.  Only UTF-8 input is supported.
+// In push mode (XmlStreamReader::PushParse), source is accumulated from append() calls and readNext() returns
+//  NeedMoreData instead of an incomplete token until finish() is called.  Source before the current token is
+//  discarded by append() once it is no longer needed, except for the start of an open element w/o child elements
+//  (e.g. <style>), so source of EndElement is only available for such elements.
+class XmlPullParser
+{
+public:
+  XmlPullParser(const char* data, size_t len, unsigned int opts);
+  void append(const char* data, size_t len);
+  void finish() { final = true; }
+  // token values are XmlStreamReader::TokenType
+  int readNext();
+  int tokenType() const { return token; }
+  int status() const { return parseStatus; }
+  unsigned int options() const { return flags; }
+  const char* name() const;
+  const char* text() const { return textOffset != NPOS ? &scratch[textOffset] : ""; }
+  const char* const* attributes() const { return attrPtrs.data(); }
+  // gets source of current node (and skips to end of node if at start element); in push mode, returns false if
+  //  end of node has not been received yet - call again after append() to continue; source is only valid until
+  //  next call to append()
+  bool readNodeSource(const char** start, const char** end);
+
+private:
+  enum TextMode { RAW_TEXT, PCDATA_TEXT, ATTR_TEXT };
+  static constexpr size_t NPOS = SIZE_MAX;
+  struct OpenTag { size_t nameOffset; size_t srcOffset; bool leaf; };
+  // min bytes to discard from start of pushBuff
+  static constexpr size_t MIN_PUSH_DISCARD = 1 << 16;
+
+  const char* src;
+  const char* pos;
+  const char* end;
+  unsigned int flags;
+  bool final = true;
+  bool bomChecked = false;
+  std::vector<char> pushBuff;
+  // incomplete token scan state for push mode, so we don't rescan from token start after every append()
+  size_t scanPos = 0;
+  char scanQuote = 0;
+  size_t fragStart = NPOS;
+  size_t fragDepth = 0;
+  int token = 0;
+  int parseStatus = 0;
+  bool selfClosing = false;
+  bool popPending = false;  // pop open tag on next readNext() so name() is valid for EndElement
+  size_t tokenStart = 0;
+  size_t nameOffset = NPOS;
+  size_t textOffset = NPOS;
+  std::vector<char> scratch;
+  std::vector<size_t> attrOffsets;
+  std::vector<const char*> attrPtrs;
+  std::string tagNames;
+  std::vector<OpenTag> openTags;
+
+  void discardSource(size_t n);
+  bool tokenComplete();
+  bool parseStartTag();
+  bool parseEndTag();
+  bool parseText();
+  bool parseMarkup();
+  void copyText(const char* s, const char* e, TextMode mode);
+  const char* decodeEntity(const char* s, const char* e);
+  bool fail(int status) { parseStatus = status; return false; }
 };
 
 class XmlStreamReader
@@ -157,45 +302,111 @@ class XmlStreamReader
   pugi::xml_parse_result parseResult;
   std::vector<pugi::xml_node> nodes;
   bool starting;
+  std::unique_ptr<XmlPullParser> pull;
+  std::vector<char> pullBuff;
+  std::shared_ptr<std::string> fragStore;  // shared by fragments from readNodeAsFragment()
+
+  std::string& fragmentStore()
+  {
+    if(!fragStore || fragStore->size() >= XmlFragment::MAX_SHARED_STORE)
+      fragStore = std::make_shared<std::string>();
+    return *fragStore;
+  }
 
 public:
   enum TokenType {NoToken=0, StartDocument, EndDocument,
-      StartElement, EndElement, CData, ProcessingInstruction, Comment, Other};
-  enum { ParseDefault = pugi::parse_default, BufferInPlace = 0x10000000 };
+      StartElement, EndElement, CData, ProcessingInstruction, Comment, Other, NeedMoreData};
+  // PullParse: tokenize directly from source w/o building DOM (BufferInPlace is implied since source is not
+  //  modified); otherwise, opts are passed to pugi
+  // PushParse: source is passed in chunks w/ appendData() (PullParse is implied); NeedMoreData is returned by
+  //  readNext() until finishData() is called
+  enum { ParseDefault = pugi::parse_default, BufferInPlace = 0x10000000, PullParse = 0x20000000,
+      PushParse = 0x40000000 };
 
   XmlStreamReader(const char* data, int len, unsigned int opts = ParseDefault) : starting(true)
   {
-    parseResult = opts & BufferInPlace ?
-        doc.load_buffer_inplace((void*)data, len, (opts & ~BufferInPlace)) : doc.load_buffer(data, len, opts);
+    if(opts & (PullParse | PushParse))
+      pull.reset(new XmlPullParser(data, len, opts));
+    else
+      parseResult = opts & BufferInPlace ?
+          doc.load_buffer_inplace((void*)data, len, (opts & ~BufferInPlace)) : doc.load_buffer(data, len, opts);
     topNode = doc;
   }
 
   XmlStreamReader(std::istream& strm, unsigned int opts = ParseDefault) : starting(true)
   {
-    doc.load(strm, opts);
+    if(opts & PullParse) {
+      // pull parser needs contiguous input, but this is still much smaller than the DOM
+      pullBuff.assign(std::istreambuf_iterator<char>(strm), std::istreambuf_iterator<char>());
+      pull.reset(new XmlPullParser(pullBuff.data(), pullBuff.size(), opts));
+    }
+    else
+      doc.load(strm, opts);
     topNode = doc;
   }
 
   // for processing only a subtree of a document
   XmlStreamReader(const pugi::xml_node& node) : topNode(node), starting(true) {}
 
-  int parseStatus() { return parseResult.status; }
+  // for PushParse
+  void appendData(const char* data, size_t len) { if(pull) pull->append(data, len); }
+  void finishData() { if(pull) pull->finish(); }
+
+  int parseStatus() { return pull ? pull->status() : parseResult.status; }
   bool atEnd() { return tokenType() == EndDocument; }
-  const char* name() { return nodes.back().name(); }
-  const char* text() { return nodes.back().value(); }
-  XmlStreamAttributes attributes() { return XmlStreamAttributes(nodes.back()); }
+  const char* name() { return pull ? pull->name() : nodes.back().name(); }
+  const char* text() { return pull ? pull->text() : nodes.back().value(); }
+  XmlStreamAttributes attributes()
+  {
+    return pull ? XmlStreamAttributes(pull->attributes()) : XmlStreamAttributes(nodes.back());
+  }
 
-  // this can be used to store unrecognized nodes
+  // this can be used to store unrecognized nodes; in push mode, returns NULL if more data is needed
   XmlFragment* readNodeAsFragment()
   {
-    // this will cause next call to readNext() to advance to next sibling of current node
+    const char* start = NULL;
+    const char* end = NULL;
+    if(pull && !pull->readNodeSource(&start, &end))
+      return NULL;
+    if(!pull) {
+      // this will cause next call to readNext() to advance to next sibling of current node
+      starting = false;
+      if(nodes.empty())
+        return new XmlFragment();
+    }
+    std::string& store = fragmentStore();
+    size_t offset = store.size();
+    if(pull)
+      store.append(start, end - start);
+    else {
+      PugiStringWriter writer(store);
+      nodes.back().print(writer, "", pugi::format_raw);
+    }
+    return new XmlFragment(fragStore, offset, store.size() - offset);
+  }
+
+  // get source of current node w/o copying (see XmlPullParser::readNodeSource()); returns false if not pull
+  //  parsing or if more data is needed
+  bool readNodeSource(const char** start, const char** end) { return pull && pull->readNodeSource(start, end); }
+  // opts passed to XmlPullParser; 0 if not pull parsing
+  unsigned int pullOpts() const { return pull ? pull->options() : 0; }
+
+  // skip current node w/o saving; in push mode, returns false if more data is needed
+  bool skipNode()
+  {
+    const char* start;
+    const char* end;
+    if(pull)
+      return pull->readNodeSource(&start, &end);
     starting = false;
-    return nodes.empty() ? new XmlFragment(pugi::xml_node()) : new XmlFragment(nodes.back());
+    return true;
   }
 
   // depth-first traversal of doc; rules: elements on stack are always valid (i.e. never null)
   TokenType readNext()
   {
+    if(pull)
+      return TokenType(pull->readNext());
     if(nodes.empty()) {
       nodes.push_back(topNode);
     }
@@ -224,6 +435,8 @@ public:
 
   TokenType tokenType()
   {
+    if(pull)
+      return TokenType(pull->tokenType());
     if(nodes.empty())
       return NoToken;
     if(nodes.size() == 1)
@@ -20,9 +20,9 @@
 
 void cleanSvg(SvgNode* node)
 {
-  for(auto it = node->attrs.begin(); it != node->attrs.end(); ++it) {
-    if(!it->stdAttr())
-      it->setFlags(it->getFlags() | SvgAttr::NoSerialize);
+  for(SvgAttr& attr : node->attrs.mut()) {
+    if(!attr.stdAttr())
+      attr.setFlags(attr.getFlags() | SvgAttr::NoSerialize);
   }
 
   SvgContainerNode* cnode = node->asContainerNode();
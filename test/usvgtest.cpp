@@ -1,6 +1,7 @@
 #include "svgparser.h"
 #include "svgpainter.h"
 #include "svgwriter.h"
+#include "svgbinary.h"
 
 #define PLATFORMUTIL_IMPLEMENTATION
 #include "ulib/platformutil.h"
@@ -24,6 +25,588 @@
 // generated with xxd -i Roboto-Regular.ttf
 #include "Roboto-Regular.inl"
 
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <thread>
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+// global operator new/delete are replaced to count heap allocations, so tests can check parser allocation behavior
+static std::atomic<size_t> svgHeapAllocCount(0);
+
+void* operator new(size_t size)
+{
+  svgHeapAllocCount.fetch_add(1, std::memory_order_relaxed);
+  void* p = malloc(size ? size : 1);
+  if(!p) abort();  // no exceptions
+  return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+// every check increments failures, so usvgtest exits w/ non-zero status if any fails
+static int failures = 0;
+#define TEST_FAIL(...) do { ++failures;  PLATFORM_LOG("Failed: " __VA_ARGS__); } while(0)
+
+static size_t countNodes(const SvgNode* node)
+{
+  size_t n = 1;
+  if(node->asContainerNode()) {
+    for(const SvgNode* child : node->asContainerNode()->children())
+      n += countNodes(child);
+  }
+  return n;
+}
+
+// resident set size (Linux only; 0 elsewhere)
+static size_t residentBytes()
+{
+#ifdef __linux__
+  long pages = 0, resident = 0;
+  FILE* f = fopen("/proc/self/statm", "r");
+  if(f) {
+    if(fscanf(f, "%ld %ld", &pages, &resident) != 2)
+      resident = 0;
+    fclose(f);
+  }
+  return resident*sysconf(_SC_PAGESIZE);
+#else
+  return 0;
+#endif
+}
+
+// correctly rounded reference for number parsing
+static real libcStrToReal(const char* s, char** endptr)
+{
+  return sizeof(real) == sizeof(double) ? real(strtod(s, endptr)) : real(strtof(s, endptr));
+}
+
+// number parsing fast path (used by toReal, parseNumbersList, and path data) must give results identical to
+//  strToReal, so check random decimal strings w/ a fixed seed; both must be correctly rounded, which is checked
+//  w/ decimal strings near halfway between adjacent reals (where rounding twice, e.g. via double for float,
+//  gives the wrong result)
+static void testNumberParsing()
+{
+  uint32_t seed = 12345;
+  auto rnd = [&seed](uint32_t n) { seed = seed*1664525u + 1013904223u;  return (seed >> 8) % n; };
+  char buff[64];
+  int nbad = 0;
+  for(int ii = 0; ii < 100000 && nbad < 10; ++ii) {
+    real r = real(std::ldexp(1 + double(rnd(1u << 23))/(1u << 23), int(rnd(60)) - 30));
+    double mid = 0.5*(double(r) + double(std::nextafter(r, real(INFINITY))));
+    // 7 - 15 significant digits, so both fast path and fallback are exercised
+    snprintf(buff, sizeof(buff), "%.*g", 7 + int(rnd(9)), rnd(2) ? mid : std::nextafter(mid, 0.0));
+    char* endptr;
+    real expected = libcStrToReal(buff, &endptr);
+    real actual = toReal(StringRef(buff), NaN);
+    real ulibval = strToReal<real>(buff, &endptr);
+    if(memcmp(&expected, &actual, sizeof(real)) != 0 || memcmp(&expected, &ulibval, sizeof(real)) != 0) {
+      TEST_FAIL("toReal(\"%s\") = %.17g, strToReal = %.17g; correctly rounded value is %.17g\n",
+          buff, double(actual), double(ulibval), double(expected));
+      ++nbad;
+    }
+  }
+
+  for(int ii = 0; ii < 200000 && nbad < 10; ++ii) {
+    char* p = buff;
+    if(rnd(4) == 0) *p++ = '-';
+    for(uint32_t n = rnd(9); n > 0; --n) *p++ = '0' + rnd(10);
+    if(rnd(2)) {
+      *p++ = '.';
+      for(uint32_t n = rnd(12); n > 0; --n) *p++ = '0' + rnd(10);
+    }
+    *p = '\0';
+    if(!strpbrk(buff, "0123456789"))
+      continue;  // no digits in mantissa
+    if(rnd(4) == 0)
+      snprintf(p, 8, "e%d", int(rnd(60)) - 30);
+    char* endptr;
+    real expected = strToReal<real>(buff, &endptr);
+    int advance = 0;
+    real actual = toReal(StringRef(buff), NaN, &advance);
+    StringRef liststr(buff);
+    std::vector<real> list;
+    parseNumbersList(liststr, list);
+    if(memcmp(&expected, &actual, sizeof(real)) != 0 || advance != endptr - buff
+        || list.size() != 1 || memcmp(&expected, &list[0], sizeof(real)) != 0) {
+      TEST_FAIL("toReal(\"%s\") = %.17g does not match strToReal = %.17g\n", buff, double(actual), double(expected));
+      ++nbad;
+    }
+  }
+
+  // microbenchmark: typical path coordinates
+  std::string nums;
+  for(int ii = 0; ii < 200000; ++ii) {
+    snprintf(buff, sizeof(buff), "%.*f ", int(rnd(4)), (int(rnd(200000)) - 100000)/real(100));
+    nums += buff;
+  }
+  auto t0 = std::chrono::steady_clock::now();
+  std::vector<real> list = parseNumbersList(StringRef(nums), 200000);
+  auto t1 = std::chrono::steady_clock::now();
+  real sum = 0;
+  for(const char* p = nums.c_str(); *p;) {
+    char* endptr;
+    sum += strToReal<real>(p, &endptr);
+    for(p = endptr; *p == ' '; ++p) {}
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  PLATFORM_LOG("Parsing %d numbers: %.2f ns/number w/ parseNumbersList, %.2f ns/number w/ strToReal (sum %g)\n",
+      int(list.size()), std::chrono::duration<double, std::nano>(t1 - t0).count()/list.size(),
+      std::chrono::duration<double, std::nano>(t2 - t1).count()/list.size(), double(sum));
+}
+
+static std::string writeSvg(SvgDocument* doc)
+{
+  XmlStreamWriter xmlwriter;
+  SvgWriter(xmlwriter).serialize(doc);
+  std::ostringstream strm;
+  xmlwriter.save(strm);
+  return strm.str();
+}
+
+// parsing more copies of the same elements must only add allocations for the nodes themselves and their attribute
+//  lists (block and storage), so any other per-element allocation in the parser fails the test
+static void testParseAllocs()
+{
+  static constexpr int N = 100;
+  static constexpr size_t ALLOCS_PER_COPY = 4;  // <g> node; <rect> node, attribute block, and attribute storage
+  auto allocsFor = [](int ncopies) {
+    std::string svg = "<svg xmlns='http://www.w3.org/2000/svg'>";
+    for(int ii = 0; ii < ncopies; ++ii)
+      svg += "<g><rect x='1' y='2' width='3' height='4' fill='#f00' stroke='#00f'/></g>";
+    svg += "</svg>";
+    size_t allocs0 = svgHeapAllocCount;
+    std::unique_ptr<SvgDocument> doc(SvgParser().parseString(svg.c_str(), svg.size(), XmlStreamReader::PullParse));
+    return doc ? svgHeapAllocCount - allocs0 : 0;
+  };
+  static constexpr size_t MAX_GROWTH_ALLOCS = 16;  // for geometric growth of buffers sized by document length
+  size_t n1 = allocsFor(N), n2 = allocsFor(2*N), limit = ALLOCS_PER_COPY*N + MAX_GROWTH_ALLOCS;
+  PLATFORM_LOG("Parsing %d more element copies: %d more heap allocations\n", N, int(n2 - n1));
+  if(n1 == 0 || n2 < n1 || n2 - n1 > limit)
+    TEST_FAIL("%d heap allocations for %d more element copies exceeds %d\n", int(n2 - n1), N, int(limit));
+}
+
+// each limit should stop parsing w/ error when exceeded, but not when exactly met
+static void testLimits()
+{
+  auto parses = [](const std::string& svg, const SvgParser::Limits& limits, unsigned int flags = 0,
+      SvgParser::OpenStreamFn openfn = nullptr) {
+    SvgParser parser;
+    parser.setFlags(flags).setLimits(limits);
+    if(openfn)
+      parser.setOpenStream(openfn);
+    std::unique_ptr<SvgDocument> doc(parser.parseString(svg.c_str()));
+    return doc && parser.error().empty();
+  };
+  const std::string svghead = "<svg xmlns='http://www.w3.org/2000/svg' xmlns:xlink='http://www.w3.org/1999/xlink'>";
+
+  SvgParser::Limits depth;
+  depth.maxDepth = 4;
+  if(!parses(svghead + "<g><g><rect/></g></g></svg>", depth)
+      || parses(svghead + "<g><g><g><g><rect/></g></g></g></g></svg>", depth))
+    TEST_FAIL("nesting depth limit\n");
+
+  // xmlns attributes of svghead are 54 bytes
+  SvgParser::Limits attrbytes;
+  attrbytes.maxAttrBytes = 128;
+  if(!parses(svghead + "<rect id='" + std::string(32, 'a') + "'/></svg>", attrbytes)
+      || parses(svghead + "<rect id='" + std::string(96, 'a') + "'/></svg>", attrbytes))
+    TEST_FAIL("attribute bytes limit\n");
+
+  // path w/ 5 points; also w/ path data parsed in parallel (LazyPathData is ignored if limit is set)
+  SvgParser::Limits points;
+  const std::string pathsvg = svghead + "<path d='M0 0 L1 1 L2 2 L3 3 L4 4'/></svg>";
+  for(unsigned int flags : {0u, unsigned(SvgParser::LazyPathData), unsigned(SvgParser::ParallelPathData)}) {
+    points.maxPathPoints = 5;
+    bool ok = parses(pathsvg, points, flags);
+    points.maxPathPoints = 4;
+    if(!ok || parses(pathsvg, points, flags))
+      TEST_FAIL("path points limit w/ flags %x\n", flags);
+  }
+
+  // <use> of file that references itself: only limit stops recursion
+  SvgParser::Limits extdepth;
+  extdepth.maxExternalDepth = 3;
+  const std::string loopsvg = svghead + "<use xlink:href='usvgtest_loop.svg'/></svg>";
+  auto openloop = [&](const char*){ return new std::istringstream(loopsvg); };
+  if(parses(loopsvg, extdepth, 0, openloop))
+    TEST_FAIL("external reference depth limit\n");
+
+  // 10x20 image headers (no image data); JPEG has APP0 and APP1 segments before SOF0, BMP has negative height
+  const char* headers[] = { "image/png;base64,iVBORw0KGgoAAAANSUhEUgAAAAoAAAAU", "image/gif;base64,R0lGODlhCgAUAA==",
+      "image/bmp;base64,Qk0AAAAAAAAAAAAAAAAAAAAACgAAAOz///8=",
+      "image/jpeg;base64,/9j/4AAQSkZJRgABAQAAAQABAAD/4QAIRXhpZgAA/8AACwgAFAAKAQERAA==" };
+  SvgParser::Limits pixels;
+  for(const char* header : headers) {
+    std::string imgsvg = svghead + "<image width='10' height='20' xlink:href='data:" + header + "'/></svg>";
+    pixels.maxImagePixels = 200;
+    bool ok = parses(imgsvg, pixels, SvgParser::LazyImages);
+    pixels.maxImagePixels = 199;
+    if(!ok || parses(imgsvg, pixels, SvgParser::LazyImages))
+      TEST_FAIL("image pixels limit for %s\n", header);
+  }
+}
+
+// lazy image w/ data URI holds only decoded bytes, not URI; bytes that can't be decoded are saved unchanged
+static void testLazyImages()
+{
+  const char* svg = "<svg xmlns='http://www.w3.org/2000/svg' xmlns:xlink='http://www.w3.org/1999/xlink'>"
+      "<image width='10' height='10' xlink:href='data:image/png;base64,AAAAAAAA'/></svg>";
+  std::unique_ptr<SvgDocument> doc(SvgParser().setFlags(SvgParser::LazyImages).parseString(svg));
+  SvgNode* node = doc ? doc->selectFirst("image") : NULL;
+  if(!node || node->type() != SvgNode::IMAGE)
+    TEST_FAIL("error parsing lazy image\n");
+  else {
+    SvgImage* img = static_cast<SvgImage*>(node);
+    if(!img->m_linkStr.empty())
+      TEST_FAIL("lazy image kept data URI\n");
+    img->image();
+    if(writeSvg(doc.get()).find("base64,AAAAAAAA") == std::string::npos)
+      TEST_FAIL("data of invalid lazy image was discarded\n");
+  }
+}
+
+// batch parsing: results must be in input order, w/ errors for missing files and empty buffers
+static void testBatchParsing(const char* svgfile)
+{
+  auto files = SvgParser::parseFiles({svgfile, "__missing__.svg", svgfile}, XmlStreamReader::ParseDefault, 0, 2);
+  if(files.size() != 3 || !files[0].doc || !files[0].error.empty() || files[1].doc || files[1].error.empty()
+      || !files[2].doc || files[0].doc == files[2].doc)
+    TEST_FAIL("parseFiles results\n");
+  for(auto& res : files)
+    delete res.doc;
+
+  // buffer is not null terminated after first doc, so empty input must not be read
+  const char* svgs = "<svg xmlns='http://www.w3.org/2000/svg' width='20' height='10'><rect width='5' height='5'/>"
+      "</svg><svg xmlns='http://www.w3.org/2000/svg' width='30' height='10'><rect width='7' height='5'/></svg>";
+  const char* second = strstr(svgs + 1, "<svg");
+  std::vector<StringRef> buffers = { StringRef(svgs, second - svgs), StringRef(second, 0), StringRef(second) };
+  auto strs = SvgParser::parseStrings(buffers);
+  if(strs.size() != 3 || !strs[0].doc || strs[0].doc->width().value != 20 || strs[1].doc
+      || strs[1].error.empty() || !strs[2].doc || strs[2].doc->width().value != 30)
+    TEST_FAIL("parseStrings results\n");
+  // bounds of documents w/o boundsCalculator can be calculated on any thread
+  else {
+    Rect b0, b2;
+    std::thread t([&](){ b0 = strs[0].doc->selectFirst("rect")->bounds(); });
+    b2 = strs[2].doc->selectFirst("rect")->bounds();
+    t.join();
+    if(b0.width() != 5 || b2.width() != 7)
+      TEST_FAIL("bounds calculated on multiple threads\n");
+  }
+  for(auto& res : strs)
+    delete res.doc;
+}
+
+// AsyncResources: <image> files and external <use> documents loaded on other threads must give same result as
+//  synchronous loading; number of uses exceeds limit on pending loads
+static void testAsyncResources(const std::string& filebase)
+{
+  std::string pngfile = filebase + "_async.png", extfile = filebase + "_async_ext.svg";
+  Image image(12, 8);
+  auto png = image.encodePNG();
+  FileStream pngout(pngfile.c_str(), "wb");
+  pngout.write(png.data(), png.size());
+  pngout.close();
+  const char* ext = "<svg xmlns='http://www.w3.org/2000/svg'><rect id='r' width='5' height='5'/></svg>";
+  FileStream extout(extfile.c_str(), "wb");
+  extout.write(ext, strlen(ext));
+  extout.close();
+
+  std::string pngname = pngfile.substr(pngfile.find_last_of("/\\") + 1);
+  std::string extname = extfile.substr(extfile.find_last_of("/\\") + 1);
+  std::string svg = "<svg xmlns='http://www.w3.org/2000/svg' xmlns:xlink='http://www.w3.org/1999/xlink'>"
+      "<image width='12' height='8' xlink:href='" + pngname + "'/>";
+  for(int ii = 0; ii < 40; ++ii)
+    svg += "<use xlink:href='" + extname + "#r'/>";
+  svg += "</svg>";
+  std::string svgfile = filebase + "_async.svg";
+  FileStream svgout(svgfile.c_str(), "wb");
+  svgout.write(svg.data(), svg.size());
+  svgout.close();
+
+  for(unsigned int flags : {0u, unsigned(SvgParser::AsyncResources),
+      unsigned(SvgParser::AsyncResources | SvgParser::LazyImages)}) {
+    std::unique_ptr<SvgDocument> doc(SvgParser().setFlags(flags).parseFile(svgfile.c_str()));
+    SvgNode* img = doc ? doc->selectFirst("image") : NULL;
+    if(!img || img->type() != SvgNode::IMAGE || static_cast<SvgImage*>(img)->image()->width != 12) {
+      TEST_FAIL("<image> loaded w/ flags %u\n", flags);
+      continue;
+    }
+    int nuses = 0;
+    for(SvgNode* node : doc->select("use")) {
+      const SvgNode* target = static_cast<SvgUse*>(node)->target();
+      const char* id = target ? target->getStringAttr("id") : NULL;
+      if(id && strcmp(id, "r") == 0)
+        ++nuses;
+    }
+    if(nuses != 40)
+      TEST_FAIL("%d of 40 external <use> targets loaded w/ flags %u\n", nuses, flags);
+  }
+  remove(svgfile.c_str());
+  remove(extfile.c_str());
+  remove(pngfile.c_str());
+}
+
+// push parsing must give same result as parsing whole buffer regardless of how input is split, including split
+//  of UTF-8 BOM; document is large enough that consumed input is discarded while parsing
+static void testPushParsing()
+{
+  std::string svg = "\xEF\xBB\xBF<svg xmlns='http://www.w3.org/2000/svg' width='100' height='100'>";
+  for(int ii = 0; ii < 4000; ++ii)
+    svg += "<rect class='c' x='" + std::to_string(ii % 100) + "' width='1' height='1' fill='blue'/><!-- r -->";
+  svg += "<style>.c { fill: red; }</style><text>abc</text></svg>";
+  std::unique_ptr<SvgDocument> ref(SvgParser().parseString(svg.data(), svg.size()));
+  size_t nref = ref ? countNodes(ref.get()) : 0;
+  color_t reffill = ref ? ref->selectFirst("rect")->getColorAttr("fill").color : 0;
+  if(nref < 4000)
+    TEST_FAIL("parsing push test document\n");
+  for(size_t chunk : {size_t(1), size_t(2), size_t(7), size_t(4096)}) {
+    SvgParser parser;
+    parser.startPush();
+    bool ok = true;
+    for(size_t ii = 0; ii < svg.size() && ok; ii += chunk)
+      ok = parser.pushData(svg.data() + ii, std::min(chunk, svg.size() - ii));
+    std::unique_ptr<SvgDocument> doc(parser.finishPush());
+    SvgNode* rect = doc ? doc->selectFirst("rect") : NULL;
+    if(!ok || !doc || countNodes(doc.get()) != nref || !rect || rect->getColorAttr("fill").color != reffill)
+      TEST_FAIL("push parsing w/ %d byte chunks\n", int(chunk));
+  }
+}
+
+static size_t countUnknownNodes(const SvgNode* node)
+{
+  size_t n = node->type() == SvgNode::UNKNOWN ? 1 : 0;
+  if(node->asContainerNode()) {
+    for(const SvgNode* child : node->asContainerNode()->children())
+      n += countUnknownNodes(child);
+  }
+  return n;
+}
+
+// unknown elements, comments, and PIs are preserved as fragments and written back unchanged (w/ either parser),
+//  or dropped w/ DiscardUnknownNodes
+static void testXmlFragments()
+{
+  const char* svg = "<svg xmlns='http://www.w3.org/2000/svg'><metadata><x:info xmlns:x='urn:x' a='1'>t</x:info>"
+      "</metadata><!-- note --><?app data?><g><rect width='5' height='5'/><foo:bar xmlns:foo='urn:foo'/></g></svg>";
+  for(unsigned int opts : {unsigned(XmlStreamReader::ParseDefault), unsigned(XmlStreamReader::PullParse)}) {
+    std::unique_ptr<SvgDocument> doc(SvgParser().parseString(svg, 0, opts | XmlFragment::parseOpts));
+    if(!doc || countUnknownNodes(doc.get()) != 4) {
+      TEST_FAIL("unknown nodes not preserved w/ opts %x\n", opts);
+      continue;
+    }
+    const SvgNode* meta = *doc->children().begin();
+    const XmlFragment* frag = meta->type() == SvgNode::UNKNOWN ?
+        static_cast<const SvgXmlFragment*>(meta)->fragment.get() : NULL;
+    if(!frag || frag->name() != "metadata")
+      TEST_FAIL("fragment name w/ opts %x\n", opts);
+    std::string out = writeSvg(doc.get());
+    std::unique_ptr<SvgDocument> doc2(SvgParser().parseString(out.c_str(), 0, XmlFragment::parseOpts));
+    if(out.find("<x:info xmlns:x=\"urn:x\" a=\"1\">t</x:info>") == std::string::npos
+        || out.find("<!-- note -->") == std::string::npos || out.find("<?app data?>") == std::string::npos
+        || !doc2 || countUnknownNodes(doc2.get()) != 4 || writeSvg(doc2.get()) != out)
+      TEST_FAIL("fragments not written unchanged w/ opts %x:\n%s\n", opts, out.c_str());
+
+    std::unique_ptr<SvgDocument> discard(
+        SvgParser().setFlags(SvgParser::DiscardUnknownNodes).parseString(svg, 0, opts | XmlFragment::parseOpts));
+    std::string discardout = discard ? writeSvg(discard.get()) : std::string();
+    if(!discard || countUnknownNodes(discard.get()) != 0 || !discard->selectFirst("rect")
+        || discardout.find("metadata") != std::string::npos || discardout.find("note") != std::string::npos)
+      TEST_FAIL("unknown nodes not discarded w/ opts %x\n", opts);
+  }
+}
+
+// LazyGroups: large groups are not parsed until needed - by namedNode() for an id inside, or by drawing unless
+//  culled using data-bbox; content can be parsed concurrently from multiple threads
+static void testLazyGroups()
+{
+  std::string svg = "<svg xmlns='http://www.w3.org/2000/svg' width='200' height='200'>";
+  for(const char* gid : {"near", "far"}) {
+    svg += std::string("<g id='") + gid + "' data-bbox='150 150 10 10'>";
+    for(int ii = 0; ii < 100; ++ii)
+      svg += "<rect id='" + std::string(gid) + std::to_string(ii) + "' x='150' y='150' width='10' height='10'/>";
+    svg += "</g>";
+  }
+  svg += "</svg>";
+  auto parse = [&](){ return SvgParser().setFlags(SvgParser::LazyGroups).parseString(
+      svg.c_str(), svg.size(), XmlStreamReader::PullParse); };
+  std::unique_ptr<SvgDocument> doc(parse());
+  SvgNode* near = doc ? doc->namedNode("near") : NULL;
+  SvgNode* far = doc ? doc->namedNode("far") : NULL;
+  if(!near || !far || !near->asContainerNode()->isLazy() || !far->asContainerNode()->isLazy()) {
+    TEST_FAIL("groups not lazy w/ LazyGroups\n");
+    return;
+  }
+  SvgNode* inner = doc->namedNode("near50");
+  if(!inner || inner->parent() != near || near->asContainerNode()->isLazy() || !far->asContainerNode()->isLazy())
+    TEST_FAIL("namedNode() for id in lazy group\n");
+
+  Image image(200, 200);
+  Painter painter(Painter::PAINT_SW | Painter::SW_NO_XC, &image);
+  painter.beginFrame();
+  SvgPainter(&painter).drawNode(doc.get(), Rect::ltwh(0, 0, 50, 50));
+  painter.endFrame();
+  if(!far->asContainerNode()->isLazy())
+    TEST_FAIL("lazy group outside dirty rect was parsed\n");
+  // namedNode() should stop taking lock once all lazy content w/ ids has been parsed
+  far->asContainerNode()->children();
+  if(doc->m_lazyState.hasIds.load() || doc->namedNode("far99")->parent() != far)
+    TEST_FAIL("lazy ids not cleared after parsing all lazy groups\n");
+
+  std::unique_ptr<SvgDocument> doc2(parse());
+  const SvgContainerNode* far2 = doc2 ? doc2->namedNode("far")->asContainerNode() : NULL;
+  size_t n1 = 0, n2 = 0;
+  if(far2) {
+    std::thread t([&](){ n1 = far2->children().size(); });
+    SvgNode* rect2 = doc2->namedNode("far99");
+    n2 = far2->children().size();
+    t.join();
+    if(n1 != 100 || n2 != 100 || !rect2 || rect2->parent() != far2)
+      TEST_FAIL("concurrent parsing of lazy group\n");
+  }
+}
+
+// SharedAttrs: nodes w/ equal attributes should share one interned block; copies of arena-allocated attributes
+//  must not share since arena is not thread-safe
+static void testSharedAttrs()
+{
+  const char* svg = "<svg xmlns='http://www.w3.org/2000/svg'><style>.x { opacity: 0.5; }</style>"
+      "<rect id='r1' fill='red' stroke='blue' stroke-width='2'/>"
+      "<rect id='r2' fill='red' stroke='blue' stroke-width='2'/>"
+      "<rect id='r3' fill='red' stroke='blue' stroke-width='2'/>"
+      "<rect id='r4' fill='green' stroke='blue'/></svg>";
+  std::unique_ptr<SvgDocument> doc(SvgParser().setFlags(SvgParser::SharedAttrs).parseString(svg));
+  SvgNode* r[4] = {};
+  for(int ii = 0; doc && ii < 4; ++ii)
+    r[ii] = doc->namedNode(("r" + std::to_string(ii+1)).c_str());
+  if(!r[0] || !r[1] || !r[2] || !r[3]) {
+    TEST_FAIL("error parsing w/ SharedAttrs\n");
+    return;
+  }
+  if(!r[0]->attrs.isInterned() || &r[0]->attrs.list() != &r[1]->attrs.list()
+      || &r[0]->attrs.list() != &r[2]->attrs.list() || &r[0]->attrs.list() == &r[3]->attrs.list())
+    TEST_FAIL("equal attributes not shared w/ SharedAttrs\n");
+  std::unique_ptr<SvgNode> copy(r[0]->clone());
+  if(&copy->attrs.list() != &r[0]->attrs.list())
+    TEST_FAIL("interned attributes not shared by clone\n");
+  if(!r[0]->restyle() || &r[0]->attrs.list() != &r[1]->attrs.list())
+    TEST_FAIL("interned attributes not restored by restyle\n");
+
+  std::unique_ptr<SvgDocument> arenadoc(SvgParser().setFlags(SvgParser::ArenaAlloc).parseString(svg));
+  SvgNode* a1 = arenadoc ? arenadoc->namedNode("r1") : NULL;
+  std::unique_ptr<SvgNode> arenacopy(a1 ? a1->clone() : NULL);
+  if(!arenacopy || arenacopy->attrs.list() != a1->attrs.list() || &arenacopy->attrs.list() == &a1->attrs.list())
+    TEST_FAIL("arena-allocated attributes not copied by clone\n");
+}
+
+static std::string replaced(std::string s, const char* from, const char* to)
+{
+  size_t pos = s.find(from);
+  return pos == std::string::npos ? s : s.replace(pos, strlen(from), to);
+}
+
+// reparse must patch document in place, keeping unchanged nodes, so that result matches a fresh parse of new
+//  source and dirty rect only covers what changed
+static void testReparse()
+{
+  // 2x2 solid red and blue PNGs
+  const char* redpng =
+      "iVBORw0KGgoAAAANSUhEUgAAAAIAAAACCAIAAAD91JpzAAAAEElEQVR4nGP4z8AARAwQCgAf7gP9i18U1AAAAABJRU5ErkJggg==";
+  const char* bluepng =
+      "iVBORw0KGgoAAAANSUhEUgAAAAIAAAACCAIAAAD91JpzAAAAD0lEQVR4nGNgYPgPRmAKABf2A/1+6zfzAAAAAElFTkSuQmCC";
+  const std::string base = "<svg xmlns='http://www.w3.org/2000/svg' xmlns:xlink='http://www.w3.org/1999/xlink' "
+      "width='200' height='200'><defs><linearGradient id='g1'><stop offset='0' stop-color='red'/>"
+      "<stop offset='1' stop-color='blue'/></linearGradient><linearGradient id='g2' xlink:href='#g1' x2='0.5'/>"
+      "</defs><rect id='a' x='10' y='10' width='20' height='20' fill='red'/>"
+      "<rect id='b' x='50' y='50' width='20' height='20' fill='url(#g2)'/>"
+      "<rect x='100' y='100' width='20' height='20'/><image id='img' x='150' y='10' width='20' height='20' "
+      "xlink:href='data:image/png;base64," + std::string(redpng) + "'/></svg>";
+  const std::string g3 = "<linearGradient id='g3'><stop offset='0' stop-color='green'/></linearGradient></defs>";
+  struct { const char* name; std::string svg; const char* aid; bool keepA; Rect dirty; } cases[] = {
+    {"attribute change", replaced(base, "fill='red'", "fill='green'"), "a", true, Rect::ltwh(10, 10, 20, 20)},
+    {"geometry change", replaced(base, "x='10'", "x='20'"), "a", false, Rect::ltwh(10, 10, 30, 20)},
+    {"insertion", replaced(base, "</svg>", "<rect id='c' x='150' y='150' width='10' height='10'/></svg>"),
+        "a", true, Rect::ltwh(150, 150, 10, 10)},
+    {"removal", replaced(base, "<rect x='100' y='100' width='20' height='20'/>", ""),
+        "a", true, Rect::ltwh(100, 100, 20, 20)},
+    {"id change", replaced(base, "id='a'", "id='a2'"), "a2", true, Rect()},
+    {"gradient relink", replaced(replaced(base, "'#g1' x2", "'#g3' x2"), "</defs>", g3.c_str()),
+        "a", true, Rect::ltwh(50, 50, 20, 20)},
+    {"spreadMethod change", replaced(base, "x2='0.5'", "x2='0.5' spreadMethod='reflect'"),
+        "a", true, Rect::ltwh(50, 50, 20, 20)},
+    {"image change", replaced(base, redpng, bluepng), "a", true, Rect::ltwh(150, 10, 20, 20)},
+  };
+  for(auto& c : cases) {
+    std::unique_ptr<SvgDocument> doc(SvgParser().parseString(base.c_str()));
+    SvgNode* a = doc->namedNode("a");
+    SvgNode* b = doc->namedNode("b");
+    SvgNode* img = doc->namedNode("img");
+    Rect abounds = a->bounds();
+    Image image(200, 200);
+    Painter painter(Painter::PAINT_SW | Painter::SW_NO_XC, &image);
+    painter.beginFrame();
+    SvgPainter(&painter).drawNode(doc.get());
+    painter.endFrame();
+    SvgPainter::clearDirty(doc.get());
+
+    SvgParser parser;
+    if(!parser.reparseString(doc.get(), c.svg.c_str()) || (parser.flags() & SvgParser::LazyImages)) {
+      TEST_FAIL("reparse w/ %s\n", c.name);
+      continue;
+    }
+    Rect dirty = SvgPainter::calcDirtyRect(doc.get());
+    std::unique_ptr<SvgDocument> ref(SvgParser().parseString(c.svg.c_str()));
+    SvgNode* newa = doc->namedNode(c.aid);
+    if(!newa || (c.keepA && newa != a) || doc->namedNode("b") != b || (c.aid[1] && doc->namedNode("a"))
+        || (strcmp(c.name, "image change") != 0 && doc->namedNode("img") != img)
+        || writeSvg(doc.get()) != writeSvg(ref.get()))
+      TEST_FAIL("document after reparse w/ %s does not match new source\n", c.name);
+    if(c.dirty.isValid() ? dirty != c.dirty : dirty.isValid() && Rect(abounds).rectUnion(dirty) != abounds)
+      TEST_FAIL("dirty rect after reparse w/ %s: %.1f %.1f %.1f %.1f\n", c.name,
+          double(dirty.left), double(dirty.top), double(dirty.width()), double(dirty.height()));
+    if(strcmp(c.name, "gradient relink") == 0) {
+      SvgNode* g2 = doc->namedNode("g2");
+      if(!g2 || static_cast<SvgGradient*>(g2)->m_link != doc->namedNode("g3"))
+        TEST_FAIL("gradient link not updated by reparse\n");
+    }
+    if(strcmp(c.name, "spreadMethod change") == 0) {
+      SvgNode* g2 = doc->namedNode("g2");
+      if(!g2 || static_cast<SvgGradient*>(g2)->gradient().spread() != Gradient::ReflectSpread)
+        TEST_FAIL("gradient spreadMethod not updated by reparse\n");
+    }
+  }
+}
+
+// compare time and memory for parsing file through stream (copy) and memory mapped (in place); RSS growth is
+//  approximate since memory freed by the first parse can be reused by the second
+static void compareParseFile(const char* svgfile)
+{
+  struct { const char* name; unsigned int opts; } modes[] = {
+      {"stream", XmlStreamReader::ParseDefault}, {"mmap", XmlStreamReader::BufferInPlace} };
+  for(auto& mode : modes) {
+    size_t rss0 = residentBytes();
+    auto t0 = std::chrono::steady_clock::now();
+    SvgDocument* doc = SvgParser().parseFile(svgfile, mode.opts);
+    auto t1 = std::chrono::steady_clock::now();
+    size_t rss1 = residentBytes();
+    if(!doc)
+      TEST_FAIL("error parsing %s w/ %s\n", svgfile, mode.name);
+    PLATFORM_LOG("parseFile w/ %s: %.3f ms, RSS +%d KB\n", mode.name,
+        std::chrono::duration<double, std::milli>(t1 - t0).count(), int((rss1 - std::min(rss0, rss1))/1024));
+    delete doc;
+  }
+}
+
 static Image paintDoc(SvgDocument* doc, int paintflags, const std::string& outpngfile)
 {
   Image image(doc->width().value, doc->height().value);
@@ -52,11 +635,78 @@ int main(int argc, char* argv[])
   std::string outpngfile = filebase + "_out.png";
   std::string outsvgfile = filebase + "_out.svg";
 
-  int res = 0;
   Painter::initFontStash(FONS_SUMMED);  //FONS_SDF
   Painter::loadFontMem("sans", Roboto_Regular_ttf, Roboto_Regular_ttf_len);
 
+  size_t allocs0 = svgHeapAllocCount;
   SvgDocument* doc = SvgParser().parseFile(svgfile);
+  if(!doc) {
+    PLATFORM_LOG("Failed to parse %s\n", svgfile);
+    return -1;
+  }
+  size_t nallocs = svgHeapAllocCount - allocs0, nnodes = countNodes(doc);
+  PLATFORM_LOG("Parsing %s: %d heap allocations for %d nodes\n", svgfile, int(nallocs), int(nnodes));
+  PLATFORM_LOG("Estimated memory: %d bytes for nodes, %d bytes for %d interned strings\n",
+      int(SvgNode::estimateMemoryUsage(doc)), int(SvgAtom::tableMemoryUsage()), int(SvgAtom::tableSize()));
+
+  testNumberParsing();
+  testParseAllocs();
+  testLimits();
+  testLazyImages();
+  testBatchParsing(svgfile);
+  testAsyncResources(filebase);
+  testPushParsing();
+  testXmlFragments();
+  testLazyGroups();
+  testSharedAttrs();
+  testReparse();
+  compareParseFile(svgfile);
+
+  // parsing should stop w/ error if a limit is exceeded
+  SvgParser::Limits limits;
+  limits.maxNodes = 1;
+  SvgParser limitParser;
+  SvgDocument* limitDoc = limitParser.setLimits(limits).parseFile(svgfile);
+  if(countNodes(doc) > 1 && (limitDoc || limitParser.error().empty()))
+    TEST_FAIL("node count limit not enforced\n");
+  delete limitDoc;
+  // fragment parsing must also stop cleanly when a limit is exceeded
+  SvgParser fragParser;
+  limits.maxNodes = 2;
+  SvgDocument* fragDoc = fragParser.setLimits(limits).parseFragment("<g><rect width='1'/><rect/><rect/></g>");
+  if(fragDoc || fragParser.error().empty())
+    TEST_FAIL("node count limit not enforced for fragment\n");
+  delete fragDoc;
+  // arena of fragment document must not remain current after parse
+  SvgDocument* arenaFrag = SvgParser().setFlags(SvgParser::ArenaAlloc).parseFragment("<g><rect/></g>");
+  if(!arenaFrag || SvgArena::current)
+    TEST_FAIL("arena still current after parseFragment\n");
+  delete arenaFrag;
+
+  // insertion before a given child and removal should preserve order
+  SvgG group;
+  SvgG* childA = new SvgG;
+  SvgG* childB = new SvgG;
+  SvgG* childC = new SvgG;
+  group.addChild(childA);
+  group.addChild(childC);
+  group.addChild(childB, childC);
+  if(*++group.children().begin() != childB || group.removeChild(childB) != childC
+      || group.children().size() != 2 || *group.children().rbegin() != childC || group.removeChild(childB))
+    TEST_FAIL("child list insertion or removal\n");
+  delete childB;
+
+  // standard attributes should be found by name or id regardless of how they were created
+  group.setAttr(SvgAttr("fill-opacity", 0.5f, SvgAttr::InlineStyleSrc));
+  group.setAttr("fill-opacity", 0.25f);
+  group.setAttr("data-value", 1);
+  if(group.getFloatAttr(SvgAttr::FILL_OPACITY) != 0.5f || group.getFloatAttr("fill-opacity") != 0.5f
+      || group.getAttr(SvgAttr::FILL_OPACITY, SvgAttr::XMLSrc)->floatVal() != 0.25f
+      || group.getAttr(SvgAttr::STROKE) || group.getIntAttr("data-value") != 1)
+    TEST_FAIL("standard attribute lookup\n");
+  group.removeAttr("fill-opacity");
+  if(group.getAttr(SvgAttr::FILL_OPACITY) || group.attrs.mayContain(SvgAttr::FILL_OPACITY))
+    TEST_FAIL("standard attribute removal\n");
 
   Painter boundsPaint(Painter::PAINT_NULL);
   SvgPainter boundsCalc(&boundsPaint);
@@ -72,15 +722,116 @@ int main(int argc, char* argv[])
   if(refpngbuff.empty())
     PLATFORM_LOG("Reference image %s not found\n", refpngfile.c_str());
   else if(refpng != image)
-    PLATFORM_LOG("Failed: rendered image does not match %s\n", refpngfile.c_str());
+    TEST_FAIL("rendered image does not match %s\n", refpngfile.c_str());
   else
     PLATFORM_LOG("Rendered image matches %s\n", refpngfile.c_str());
 
+  // binary snapshot should render identically to original document
+  std::vector<char> snapshot = SvgBinaryWriter::serialize(doc);
+  auto tbin0 = std::chrono::steady_clock::now();
+  SvgDocument* bindoc = SvgBinaryReader::load(snapshot.data(), snapshot.size());
+  double binms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tbin0).count();
+  PLATFORM_LOG("Loading %d KB binary snapshot: %.3f ms (%.0f MB/s)\n", int(snapshot.size()/1024), binms,
+      snapshot.size()/(1024*1024*std::max(binms, 0.001)/1000));
+  if(!bindoc)
+    TEST_FAIL("error loading binary snapshot\n");
+  else {
+    bindoc->boundsCalculator = &boundsCalc;
+    if(paintDoc(bindoc, Painter::PAINT_SW | Painter::SW_NO_XC, filebase + "_bin_out.png") != image)
+      TEST_FAIL("binary snapshot rendering does not match\n");
+    delete bindoc;
+  }
+  // truncated snapshot and excessive nesting must be rejected
+  for(size_t len : {snapshot.size()/3, snapshot.size() - 1}) {
+    if((bindoc = SvgBinaryReader::load(snapshot.data(), len))) {
+      TEST_FAIL("truncated binary snapshot loaded\n");
+      delete bindoc;
+    }
+  }
+  std::string deepsvg = "<svg xmlns='http://www.w3.org/2000/svg'>";
+  for(size_t ii = 0; ii < SvgBinaryReader::MAX_DEPTH + 1; ++ii) deepsvg += "<g>";
+  for(size_t ii = 0; ii < SvgBinaryReader::MAX_DEPTH + 1; ++ii) deepsvg += "</g>";
+  deepsvg += "</svg>";
+  std::unique_ptr<SvgDocument> deepdoc(SvgParser().parseString(deepsvg.c_str()));
+  std::vector<char> deepsnap = deepdoc ? SvgBinaryWriter::serialize(deepdoc.get()) : std::vector<char>();
+  bindoc = deepdoc ? SvgBinaryReader::load(deepsnap.data(), deepsnap.size()) : NULL;
+  if(!deepdoc || bindoc) {
+    TEST_FAIL("binary snapshot nesting limit\n");
+    delete bindoc;
+  }
+
+  // lazily parsed groups should render identically
+  SvgDocument* lazydoc = SvgParser().setFlags(SvgParser::LazyGroups).parseFile(svgfile, XmlStreamReader::PullParse);
+  if(!lazydoc)
+    TEST_FAIL("error parsing with LazyGroups\n");
+  else {
+    lazydoc->boundsCalculator = &boundsCalc;
+    if(paintDoc(lazydoc, Painter::PAINT_SW | Painter::SW_NO_XC, filebase + "_lazy_out.png") != image)
+      TEST_FAIL("LazyGroups rendering does not match\n");
+    delete lazydoc;
+  }
+
+  // document allocated from arena should render identically
+  allocs0 = svgHeapAllocCount;
+  SvgDocument* arenadoc = SvgParser().setFlags(SvgParser::ArenaAlloc).parseFile(svgfile);
+  if(!arenadoc)
+    TEST_FAIL("error parsing with ArenaAlloc\n");
+  else {
+    PLATFORM_LOG("Parsing %s w/ ArenaAlloc: %d heap allocations\n", svgfile, int(svgHeapAllocCount - allocs0));
+    arenadoc->boundsCalculator = &boundsCalc;
+    if(paintDoc(arenadoc, Painter::PAINT_SW | Painter::SW_NO_XC, filebase + "_arena_out.png") != image)
+      TEST_FAIL("ArenaAlloc rendering does not match\n");
+    // owning arena is found from block address; nodes of default document are from heap
+    const SvgNode* arenachild = arenadoc->children().front();
+    const SvgNode* heapchild = doc->children().front();
+    if((arenachild && SvgArena::owner(arenachild) != arenadoc->arena()) || (heapchild && SvgArena::owner(heapchild)))
+      TEST_FAIL("wrong arena for node\n");
+    delete arenadoc;
+  }
+
+  // document with shared attribute lists should render identically
+  SvgDocument* shareddoc = SvgParser().setFlags(SvgParser::SharedAttrs).parseFile(svgfile);
+  if(!shareddoc)
+    TEST_FAIL("error parsing with SharedAttrs\n");
+  else {
+    PLATFORM_LOG("Estimated memory w/ SharedAttrs: %d bytes for nodes, %d shared attribute lists\n",
+        int(SvgNode::estimateMemoryUsage(shareddoc)), int(SvgAttrSet::tableSize()));
+    shareddoc->boundsCalculator = &boundsCalc;
+    if(paintDoc(shareddoc, Painter::PAINT_SW | Painter::SW_NO_XC, filebase + "_shared_out.png") != image)
+      TEST_FAIL("SharedAttrs rendering does not match\n");
+    delete shareddoc;
+  }
+
+  // external documents are only shared between parses w/ same flags and stream handler
+  auto ext1 = SvgParser::loadExternalDocument(svgfile, 0);
+  auto ext2 = SvgParser::loadExternalDocument(svgfile, 0);
+  auto ext3 = SvgParser::loadExternalDocument(svgfile, SvgParser::DiscardUnknownNodes);
+  SvgParser streamParser;
+  streamParser.setOpenStream([](const char* f){ return new std::ifstream(f); });
+  auto ext4 = streamParser.loadExternal(svgfile);
+  auto ext5 = streamParser.loadExternal(svgfile);
+  if(!ext1 || ext1 != ext2 || ext1 == ext3 || !ext4 || ext1 == ext4 || ext4 != ext5)
+    TEST_FAIL("external document cache key\n");
+
+  // documents with identical <style> content should share one compiled stylesheet
+  SvgDocument* doc2 = SvgParser().parseFile(svgfile);
+  if(doc2 && doc2->stylesheet() != doc->stylesheet())
+    TEST_FAIL("stylesheet not shared between documents\n");
+  delete doc2;
+
+  // reparsing unchanged file should leave document unchanged
+  if(!SvgParser().reparseFile(doc, svgfile))
+    TEST_FAIL("error reparsing %s\n", svgfile);
+  else if(paintDoc(doc, Painter::PAINT_SW | Painter::SW_NO_XC, filebase + "_reparse_out.png") != image)
+    TEST_FAIL("rendering after reparse does not match\n");
+
   SvgWriter::DEBUG_CSS_STYLE = true;
   XmlStreamWriter xmlwriter;
   SvgWriter(xmlwriter).serialize(doc);
   xmlwriter.saveFile(outsvgfile.c_str());
 
   delete doc;
-  return res;
+  if(failures)
+    PLATFORM_LOG("%d checks failed\n", failures);
+  return failures ? 1 : 0;
 }